@@ -12,15 +12,35 @@ constexpr std::size_t BYTE_ALIGNMENT = 32; // 32-byte alignment for AVX
 constexpr std::size_t BYTE_ALIGNMENT = 32; // Default 32-byte alignment
 #endif
 
-template<typename FType>
+// size of a cache line, per thread buffers are padded to it so no two threads write into the same line
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+// rounds n up to the next multiple of multiple
+constexpr std::size_t paddedSize(const std::size_t n, const std::size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+// number of elements of a row of cols values once it is padded so that every row starts on a BYTE_ALIGNMENT boundary
+template <typename FType>
+constexpr std::size_t alignedRowSize(const std::size_t cols) {
+    return paddedSize(cols, BYTE_ALIGNMENT / sizeof(FType));
+}
+
+template<typename FType, std::size_t Alignment = BYTE_ALIGNMENT>
 struct AlignedAllocator{
 
     using value_type = FType;
 
+    // needed because of the non type template parameter, std::allocator_traits can not deduce it
+    template<typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
     AlignedAllocator() = default;
 
     template<typename U>
-    AlignedAllocator(const AlignedAllocator<U>& other) noexcept {}
+    AlignedAllocator(const AlignedAllocator<U, Alignment>& other) noexcept {}
 
     FType* allocate(std::size_t n){
 
@@ -30,7 +50,7 @@ struct AlignedAllocator{
         
         std::size_t bytes = n * sizeof(FType);
         void* p = nullptr;
-        if (posix_memalign(&p, BYTE_ALIGNMENT, bytes) != 0)
+        if (posix_memalign(&p, Alignment, bytes) != 0)
         {
               throw std::bad_alloc();
         }
@@ -45,10 +65,10 @@ struct AlignedAllocator{
     }
 
     template <typename U>
-    bool operator==(const AlignedAllocator<U>& other) {return true;}
+    bool operator==(const AlignedAllocator<U, Alignment>& other) {return true;}
 
     template <typename U>
-    bool operator!=(const AlignedAllocator<U>& other) {return false;}
+    bool operator!=(const AlignedAllocator<U, Alignment>& other) {return false;}
 
 };
 
@@ -0,0 +1,56 @@
+#ifndef BATCH_KMEANS_H
+#define BATCH_KMEANS_H
+
+#include <vector>
+#include <optional>
+#include <concepts>
+#include <cstddef>
+
+// settings shared by all groups of fitBatch
+struct BatchOptions {
+
+    int max_iter = 300;
+    double tol = 1e-4;
+    std::optional<int> seed;
+
+    // groups with at least team_rows rows are fitted one after the other by all threads
+    // smaller groups are fitted by a single thread each, as many at the same time as there are threads
+    std::size_t team_rows = std::size_t(1) << 14;
+
+};
+
+// centroids, labels and fit statistics of all groups of fitBatch, packed one group after the other
+template <std::floating_point FType>
+struct BatchResult {
+
+    // group g owns the centroid rows centroid_offsets[g] to centroid_offsets[g + 1] with cols values per row
+    std::vector<FType> centroids;
+    std::vector<std::size_t> centroid_offsets;
+
+    // label of every row of the input, the index of its centroid inside its own group
+    std::vector<int> labels;
+
+    std::vector<int> n_iter;
+    std::vector<double> inertia;
+
+};
+
+// Fits n_groups independent k-means models on a ragged buffer in one call, e.g. one model per user or session
+// Group g has the rows row_offsets[g] to row_offsets[g + 1] of data (cols values each, stride elements between
+// the rows) and n_clusters[g] clusters. Every group runs the same Lloyd iterations as Parallel_KMeans (random rows
+// as initial centroids, empty clusters are reseeded, converged once no centroid moves by tol or more) but without
+// building a model or logging, and a team group opens one parallel region for all of its iterations instead of a
+// fork/join per iteration. The random generator of group g is seeded from the seed
+// and g, so the result of a group fitted by a single thread does not depend on the number of threads or the order
+// of the groups. Returns false if the offsets or the number of clusters of a group are invalid
+template <std::floating_point FType>
+bool fitBatch(const FType* data,
+              const std::size_t cols,
+              const std::size_t stride,
+              const std::size_t* row_offsets,
+              const std::size_t n_groups,
+              const int* n_clusters,
+              BatchResult<FType>& result,
+              const BatchOptions& options = BatchOptions{});
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef BULK_PREDICT_H
+#define BULK_PREDICT_H
+
+#include <Cont_Mem_Parallel_KMeans.h>
+#include <Chunk_Source.h>
+
+#include <string>
+#include <concepts>
+
+// Binary: labels as int32 in output, distances as FType in output + ".distances"
+// Text: one line per row with the label or "label,distance"
+enum class PredictionFormat { Binary, Text };
+
+// Predicts all rows of input in chunks of chunk_rows and writes the results to output_filename
+// Reading the next chunk, predicting the current one and writing the previous one overlap, so the memory
+// stays at two chunks of rows and results no matter how large the input is. Returns false on a read or write error
+template <std::floating_point FType>
+bool predictStream(const Parallel_KMeans<FType>& kmeans, 
+                   RowStream<FType>& input, 
+                   const std::string& output_filename, 
+                   const PredictionFormat format = PredictionFormat::Binary, 
+                   const bool write_distances = false,
+                   const std::size_t chunk_rows = std::size_t(1) << 16);
+
+#endif
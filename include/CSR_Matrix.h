@@ -0,0 +1,87 @@
+#ifndef CSR_MATRIX_H
+#define CSR_MATRIX_H
+
+#include <vector>
+#include <concepts>
+#include <iostream>
+
+// Compressed Sparse Row matrix (same layout as scipy.sparse.csr_matrix)
+// row i has its nonzeros in values[indptr[i] .. indptr[i + 1]) at the columns indices[indptr[i] .. indptr[i + 1])
+template <std::floating_point FType, std::integral IType = std::size_t>
+struct CSR_Matrix {
+
+    IType rows;
+    IType cols;
+
+    std::vector<IType> indptr;
+    std::vector<IType> indices;
+    std::vector<FType> values;
+
+    CSR_Matrix() : rows{0}, cols{0}, indptr(1, 0) {}
+
+    CSR_Matrix(const IType n_rows, const IType n_cols, std::vector<IType> row_ptr, std::vector<IType> col_indices, std::vector<FType> nz_values)
+        : rows{n_rows},
+        cols{n_cols},
+        indptr(std::move(row_ptr)),
+        indices(std::move(col_indices)),
+        values(std::move(nz_values))
+        {}
+
+    IType nnz() const { return values.size(); }
+
+    // checks that the three arrays describe a valid rows x cols matrix
+    bool is_valid() const {
+
+        if (indptr.size() != rows + 1 || indptr[0] != 0 || indptr[rows] != values.size() || indices.size() != values.size())
+        {
+            return false;
+        }
+
+        for (IType row = 0; row < rows; ++row)
+        {
+            if (indptr[row] > indptr[row + 1])
+            {
+                return false;
+            }
+        }
+
+        for (IType idx = 0; idx < indices.size(); ++idx)
+        {
+            if (indices[idx] >= cols)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+};
+
+// Builds a CSR matrix from nested dense vectors by dropping all the zero entries
+template <std::floating_point FType, std::integral IType = std::size_t>
+CSR_Matrix<FType, IType> DenseToCSR(const std::vector<std::vector<FType>>& data) {
+
+    CSR_Matrix<FType, IType> csr;
+    csr.rows = data.size();
+    csr.cols = data.empty() ? 0 : data[0].size();
+    csr.indptr.reserve(csr.rows + 1);
+
+    for (IType row = 0; row < csr.rows; ++row)
+    {
+        for (IType col = 0; col < csr.cols; ++col)
+        {
+            if (data[row][col] != 0)
+            {
+                csr.indices.push_back(col);
+                csr.values.push_back(data[row][col]);
+            }
+        }
+
+        csr.indptr.push_back(csr.values.size());
+    }
+
+    return csr;
+}
+
+#endif
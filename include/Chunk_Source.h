@@ -0,0 +1,40 @@
+#ifndef CHUNK_SOURCE_H
+#define CHUNK_SOURCE_H
+
+#include <concepts>
+#include <cstddef>
+
+// Source of dense rows that are not resident in memory, used by the out of core fit of Parallel_KMeans
+// readRows writes rows [first_row, first_row + n_rows) into buffer, every row padded with zeros
+// to alignedRowSize<FType>(cols()) elements, and returns false if the rows can not be read
+// readRows is only called by one thread at a time but not always by the same one
+template <std::floating_point FType>
+class ChunkSource {
+
+public:
+
+    virtual ~ChunkSource() = default;
+
+    virtual std::size_t rows() const = 0;
+    virtual std::size_t cols() const = 0;
+    virtual bool readRows(const std::size_t first_row, const std::size_t n_rows, FType* buffer) const = 0;
+
+};
+
+// Sequential source of dense rows, used where the input is read once from the front to the back (bulk predict)
+// readRows writes up to max_rows padded rows into buffer and returns how many it wrote,
+// 0 at the end of the input or after an error which good() reports
+template <std::floating_point FType>
+class RowStream {
+
+public:
+
+    virtual ~RowStream() = default;
+
+    virtual std::size_t cols() const = 0;
+    virtual std::size_t readRows(FType* buffer, const std::size_t max_rows) = 0;
+    virtual bool good() const = 0;
+
+};
+
+#endif
@@ -6,9 +6,22 @@
 #include <iostream>
 #include <concepts>
 #include <optional>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <atomic>
 #include <Aligned_Allocator.h>
+#include <CSR_Matrix.h>
+#include <Dataset.h>
+#include <Chunk_Source.h>
 
-template <std::floating_point FType, std::integral IType = std::size_t>
+// runs the parallel loops of the engine either in an OpenMP team per loop or on the shared work stealing ThreadPool
+enum class ParallelBackend { OpenMP, ThreadPool };
+
+// AType is the type used to accumulate the centroid sums in updateCentroids
+// double by default so that float fits converge to the tolerance instead of running until max_iter
+template <std::floating_point FType, std::integral IType = std::size_t, std::floating_point AType = double>
 class Parallel_KMeans {
 
 public:
@@ -21,23 +34,218 @@ public:
     double inertia;
     std::mt19937 gen;
 
+    // if set the centroids, inertia and n_iter are bitwise identical for any number of threads
+    // the reductions then run over fixed size row blocks that are merged in a fixed tree order
+    bool deterministic = false;
+
+    // upper bound in bytes for the per thread partial sums of updateCentroids, above it every thread
+    // accumulates only the clusters it owns straight into the shared sums which needs O(k*d) memory
+    std::size_t reduction_memory_limit = std::size_t(256) << 20;
+
+    // if the centroid matrix is larger than this many bytes assignCentroids switches to a tiled kernel
+    // that keeps tiles of this size in the cache, should be about the per core L2 size
+    std::size_t centroid_tile_bytes = std::size_t(256) << 10;
+
+    // predict batches with fewer rows run on the calling thread without starting an OpenMP parallel region
+    // and rank the centroids by |c|^2 - 2 x.c with the centroid norms kept since the last fit, nothing is allocated
+    IType small_batch_rows = 64;
+
+    // OpenMP starts a team of OMP_NUM_THREADS threads for every parallel loop, with ThreadPool the loops run on the
+    // workers of ThreadPool::shared() instead, so models that fit or predict at the same time share one capped set of
+    // threads and rows that are cheaper than others are balanced by stealing
+    ParallelBackend parallel_backend = ParallelBackend::OpenMP;
+
+    // out of core fit: size in bytes of one of the two chunk buffers that are streamed from the source
+    // and whether the labels of all rows are kept (rows * sizeof(int) bytes) or labels stays empty
+    std::size_t stream_chunk_bytes = std::size_t(256) << 20;
+    bool stream_labels = true;
+
+    // online k-means of partialFit: before every batch the weight of the rows a centroid has seen so far is multiplied
+    // by partial_fit_decay, 1 keeps the count based running mean of all batches, below 1 old batches fade out with a
+    // memory of about 1 / (1 - partial_fit_decay) batches so the centroids follow a drifting distribution
+    double partial_fit_decay = 1.0;
+    // clusters whose decayed weight fell below reassignment_ratio times the largest weight (e.g. the empty clusters of
+    // the first batch) are moved to rows of the current batch, picked with a probability proportional to their
+    // squared distance to their centroid
+    double reassignment_ratio = 0.01;
+
+    // if set fit starts from the current centroids (from setCentroids, load or a previous fit) instead of
+    // random rows of the data, as long as they have the same number of features as the data
+    bool warm_start = false;
+
+    // periodic checkpoints of the fit loop: if checkpoint_file is set the centroids, the iteration, the inertia and the
+    // RNG state are written every checkpoint_every iterations or checkpoint_seconds seconds (0 disables a trigger)
+    // the file is written by a background thread while the next iterations run
+    std::string checkpoint_file;
+    int checkpoint_every = 0;
+    double checkpoint_seconds = 0;
+
+    // set if the last fit was stopped by cancel, the centroids are then those after n_iter iterations
+    bool cancelled = false;
+
+    // number of features of the fitted data and the padded row length of the centroids
+    // every centroid row starts on a BYTE_ALIGNMENT boundary and is padded with zeros up to row_stride
+    IType n_features = 0;
+    IType row_stride = 0;
+
     std::vector<FType, AlignedAllocator<FType>> centroids;
     std::vector<int> labels;
 
     Parallel_KMeans(const int n_cluster, const int max_iter, const double tol, std::optional<int> seed = std::nullopt);
     void fit(const std::vector<std::vector<FType>>& data);
+    // flat row major input with stride elements between rows, used in place if the rows need no padding
+    // (stride == cols == alignedRowSize(cols)) and it is BYTE_ALIGNMENT aligned otherwise it is repacked once
+    void fit(const FType* data, const IType rows, const IType cols, const IType stride);
+    // the zero padded rows of a Dataset are always used in place
+    void fit(const Dataset<FType>& data);
     std::vector<int> predict(const std::vector<std::vector<FType>>& new_data);
 
+    // rows in the padded layout (row_stride elements per row, BYTE_ALIGNMENT aligned), writes the label
+    // and if distances is not nullptr the euclidean distance to the nearest centroid of every row
+    void predict(const FType* data, const IType rows, int* new_labels, FType* distances = nullptr) const;
+
+    // same for rows of cols values with stride elements between the rows in any layout (e.g. a NumPy array)
+    // rows that are not aligned or have padding of unknown content (stride != row_stride) are copied one at a time
+    // into a per thread row buffer so the input is never repacked as a whole, returns false if cols does not match
+    // the centroids. Zero padded rows (e.g. of a Dataset) can be passed to the padded overload above instead
+    bool predict(const FType* data, const IType rows, const IType cols, const IType stride, int* new_labels, FType* distances = nullptr) const;
+
+    // distance of every row to every centroid (the transform of scikit-learn) written row major into distances,
+    // a preallocated rows x n_cluster matrix with distance_stride elements between its rows (an aligned buffer or a
+    // NumPy array), squared keeps the squared euclidean distances. Uses the norm expansion |x|^2 - 2 x.c + |c|^2 on
+    // tiles of rows and centroids, returns false if cols does not match the centroids
+    bool transform(const FType* data, const IType rows, const IType cols, const IType stride, FType* distances, const IType distance_stride, const bool squared = false) const;
+
+    // the m nearest centroids of every row and their euclidean distances, nearest first, written as rows x m values
+    // into indices and distances (distances may be nullptr). Every row keeps a sorted list of its m best candidates
+    // while the centroids are scanned, so the rows x n_cluster matrix is never built. Returns false if cols does not
+    // match the centroids or m is not in [1, n_cluster]
+    bool predictTopK(const FType* data, const IType rows, const IType cols, const IType stride, const int m, int* indices, FType* distances = nullptr) const;
+
+    // updates the centroids with one batch of rows of cols values with stride elements between the rows, the batch is
+    // not kept so the memory stays O(n_cluster * n_features) and the work is proportional to the batch. The rows are
+    // assigned in parallel like predict and every centroid moves to the weighted mean of its past rows and its new
+    // rows. Without centroids (from a fit, setCentroids, load or an earlier batch) random rows of the first batch
+    // become the centroids, after a fit the cluster sizes of its labels are the initial weights and centroids without
+    // labels start with the weight of an even share of the batch. labels and inertia
+    // describe the last batch and n_iter counts the batches, returns false if cols does not match the centroids or
+    // the first batch has fewer rows than clusters
+    bool partialFit(const FType* data, const IType rows, const IType cols, const IType stride);
+
+    // replaces the centroids by n_cluster rows of cols features with stride elements between the rows
+    // so a model can be used for predict without fitting it first, returns false if the shape does not fit
+    bool setCentroids(const FType* new_centroids, const IType rows, const IType cols, const IType stride);
+
+    // writes the centroids, their shape and dtype, inertia, n_iter and the fit parameters into a binary model file
+    // the file is written to <filename>.tmp and renamed so a reader never sees a partial model, returns false on error
+    bool save(const std::string& filename) const;
+
+    // memory maps a file written by save and builds a model that can predict right away
+    // set warm_start on it to refit from the saved centroids, returns nullptr if the file can not be read
+    static std::unique_ptr<Parallel_KMeans> load(const std::string& filename);
+
+    // loads a checkpoint with the parameters of the interrupted fit, the next fit on the same data continues with
+    // the iteration after the checkpoint and gives the same result as the uninterrupted fit
+    // the checkpoint_* and memory settings are not stored and have to be set again, returns nullptr on error
+    static std::unique_ptr<Parallel_KMeans> resume(const std::string& filename);
+
+    // asks the running fit to stop, it is checked before every Lloyd iteration so the fit stops after the current one
+    // can be called from any thread, it is ignored if no fit is running so a late cancel never stops a later fit
+    void cancel();
+
+    // marks a fit as running before it is started on another thread, so a cancel that arrives before the fit
+    // reaches its first iteration stops it there instead of being ignored
+    void prepareFit();
+
+    // out of core path, every iteration streams the rows in chunks of stream_chunk_bytes from the source
+    // and reads the next chunk while the current one is processed, only two chunks are resident
+    void fit(const ChunkSource<FType>& source);
+
+    // sparse input path, the data is never densified so memory and work per iteration scale with nnz
+    void fit(const CSR_Matrix<FType, IType>& data);
+    std::vector<int> predict(const CSR_Matrix<FType, IType>& new_data);
+
 private:
-    
 
+    // minimum number of rows per block and bounds on the number of block partial sums in deterministic mode
+    static constexpr IType DETERMINISTIC_BLOCK_ROWS = 1024;
+    static constexpr IType DETERMINISTIC_MAX_BLOCKS = 128;
+    static constexpr IType DETERMINISTIC_MAX_ELEMENTS = IType(1) << 24;
+
+    // persistent scratch buffers of updateCentroids so the Lloyd iterations do not allocate
+    // reduction_sums holds one cache line padded slice per thread (or per block in deterministic mode)
+    std::vector<AType, AlignedAllocator<AType, CACHE_LINE_SIZE>> reduction_sums;
+    std::vector<int, AlignedAllocator<int, CACHE_LINE_SIZE>> reduction_counts;
+    std::vector<AType> centroid_sums;
+    std::vector<int> cluster_counts;
 
+    // number of points that share one pass over a centroid tile in assignCentroidsTiled
+    static constexpr IType ASSIGN_POINT_TILE = 64;
+    // rows whose dot products with one centroid are computed together by transform so every centroid value
+    // loaded into a register is used TRANSFORM_ROW_BLOCK times
+    static constexpr IType TRANSFORM_ROW_BLOCK = 4;
+    std::vector<FType> point_distances;
 
-    void initializeCentroids(const std::vector<FType, AlignedAllocator<FType>>& data, const IType rows, const IType cols);
-    void ReinitializeCentroids(const std::vector<FType, AlignedAllocator<FType>>& data, std::vector<FType, AlignedAllocator<FType>>& new_centroids, int cluster_idx, const IType rows, const IType cols);
-    void assignCentroids(const std::vector<FType, AlignedAllocator<FType>>& data, const IType rows, const IType cols);
-    void updateCentroids(const std::vector<FType, AlignedAllocator<FType>>& data, std::vector<FType, AlignedAllocator<FType>>& new_centroids, const IType rows, const IType cols);
+    // iterations per chunk of the thread pool for loops over rows or elements
+    static constexpr IType PARALLEL_GRAIN = 1024;
+    // partial inertia of every slot of parallelFor, one cache line each
+    std::vector<double, AlignedAllocator<double, CACHE_LINE_SIZE>> slot_inertia;
+
+    // state of a fit that is resumed from a checkpoint and of the checkpoint that is written in the background
+    int resume_iter = 0;
+    IType checkpoint_rows = 0;
+    std::chrono::steady_clock::time_point last_checkpoint;
+    std::future<bool> pending_checkpoint;
+
+    // cancel_requested only applies to the run that is marked by fit_running, both are reset when the run ends
+    std::atomic<bool> cancel_requested{false};
+    std::atomic<bool> fit_running{false};
+
+    // squared norms of the centroids for the small batch predict, updated whenever a fit or setCentroids finishes
+    std::vector<FType> small_batch_norms;
+
+    // (decayed) number of rows every centroid of partialFit has absorbed, empty until the first batch
+    std::vector<AType> cluster_weights;
+
+    void fitAligned(const FType* data, const IType rows, const IType n_cols);
+    bool warmStart(const IType rows, const IType n_cols);
+    void startCheckpoints();
+    void checkpoint(const int iter, const IType rows);
+    void finishCheckpoints();
+    void startRun();
+    void finishRun();
+    bool stopRequested(const int iter);
+    void updateCentroidNorms();
+    void reseedClusters(const FType* data, const IType rows, const IType stride);
+    void predictSmallBatch(const FType* data, const IType rows, const IType cols, const IType stride, int* new_labels, FType* distances) const;
+    void initializeCentroids(const FType* data, const IType rows, const IType cols);
+    void ReinitializeCentroids(const FType* data, std::vector<FType, AlignedAllocator<FType>>& new_centroids, int cluster_idx, const IType rows, const IType cols);
+    void assignCentroids(const FType* data, const IType rows, const IType cols);
+    void updateCentroids(const FType* data, std::vector<FType, AlignedAllocator<FType>>& new_centroids, const IType rows, const IType cols);
     bool calculateChange(std::vector<FType, AlignedAllocator<FType>>& new_centroids, const IType cols);
+    int nearestCentroid(const FType* data_ptr, const IType cols, FType& min_distance) const;
+    void assignCentroidsTiled(const FType* data, const IType rows, const IType cols);
+
+    template <typename PointAssigner>
+    double assignPoints(const IType rows, PointAssigner assign_point);
+    template <typename RowAccumulator>
+    void reduceCentroidSums(const IType rows, const IType cols, RowAccumulator accumulate_row);
+    template <typename RowAccumulator>
+    void reduceCentroidSumsDeterministic(const IType rows, const IType cols, RowAccumulator accumulate_row);
+    IType deterministicBlockRows(const IType rows, const IType block_size) const;
+
+    // calls body(first, last, slot) on disjoint ranges that cover [0, n) with the selected backend
+    // slot < parallelSlots() is unique among the threads running at the same time and indexes per thread buffers
+    template <typename Body>
+    void parallelFor(const IType n, const IType grain, Body body) const;
+    IType parallelSlots() const;
+
+    void initializeCentroids(const CSR_Matrix<FType, IType>& data);
+    void ReinitializeCentroids(const CSR_Matrix<FType, IType>& data, std::vector<FType, AlignedAllocator<FType>>& new_centroids, int cluster_idx);
+    void assignCentroids(const CSR_Matrix<FType, IType>& data, const std::vector<FType>& row_norms);
+    void updateCentroids(const CSR_Matrix<FType, IType>& data, std::vector<FType, AlignedAllocator<FType>>& new_centroids);
+    std::vector<FType> calculateRowNorms(const CSR_Matrix<FType, IType>& data);
+    std::vector<FType> calculateCentroidNorms(const IType cols) const;
 
 
 
@@ -0,0 +1,99 @@
+#ifndef DATA_LOADER_H
+#define DATA_LOADER_H
+
+#include <Dataset.h>
+#include <Chunk_Source.h>
+
+#include <string>
+#include <memory>
+#include <concepts>
+
+// file formats that can be loaded, Auto picks the format from the file name
+enum class DataFormat { Auto, Delimited, Npy, Idx, Cache };
+
+// column of a delimited file that holds the label of a row
+enum class LabelColumn { None, First, Last };
+
+// Reads an ARFF or CSV file, plain or gzipped, straight into the padded flat layout of Dataset
+// The number of columns is taken from the @attribute lines of an ARFF header or from the first data row
+// so files of any width can be read. The file is inflated on one thread while blocks of lines are parsed
+// in parallel by OpenMP tasks. With collect_statistics the feature statistics for scaling are accumulated into
+// dataset.statistics while the parsed rows are still in the cache. Returns false if the file can not be read
+template <std::floating_point FType>
+bool readDelimited(const std::string& filename, Dataset<FType>& dataset, const LabelColumn label_column = LabelColumn::Last, const bool collect_statistics = false);
+
+// Reads an ARFF or CSV file, plain or gzipped, a few rows at a time so the memory does not grow with the file
+// The header is read by open, the labels of the rows are skipped
+template <std::floating_point FType>
+class DelimitedRowStream : public RowStream<FType> {
+
+public:
+
+    DelimitedRowStream();
+    ~DelimitedRowStream();
+
+    DelimitedRowStream(const DelimitedRowStream&) = delete;
+    DelimitedRowStream& operator=(const DelimitedRowStream&) = delete;
+
+    bool open(const std::string& filename, const LabelColumn label_column = LabelColumn::Last);
+
+    std::size_t cols() const override;
+    std::size_t readRows(FType* buffer, const std::size_t max_rows) override;
+    bool good() const override;
+
+    // number of malformed rows that were skipped so far
+    std::size_t skippedRows() const;
+
+private:
+
+    struct State;
+    std::unique_ptr<State> state;
+
+};
+
+// Reads a 2D C order float32/float64 NumPy .npy file by memory mapping it
+// If the dtype matches FType and every row already starts on a BYTE_ALIGNMENT boundary the dataset is a view
+// of the mapped file and nothing is copied, otherwise the rows are converted and padded in one parallel pass
+template <std::floating_point FType>
+bool readNpy(const std::string& filename, Dataset<FType>& dataset);
+
+// position of the rows in an uncompressed binary file (.npy or .kmcache) that is read without loading it
+// stride is the number of elements between two rows in the file
+struct BinaryLayout {
+
+    std::size_t item_size = 0;
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+    std::size_t data_offset = 0;
+
+};
+
+// reads and validates only the header of a .npy file
+bool readNpyLayout(const std::string& filename, BinaryLayout& layout);
+
+// Reads an MNIST style IDX file (e.g. train-images-idx3-ubyte), plain or gzipped, in one pass
+// All dimensions after the first are flattened into the columns and the big endian values are converted to FType
+// while they are written into the padded buffer. The labels are read from an IDX1 file if labels_filename is not empty
+template <std::floating_point FType>
+bool readIdx(const std::string& images_filename, const std::string& labels_filename, Dataset<FType>& dataset);
+
+// Reads a data set with the reader of the given format, labels_filename is only used for IDX files
+// and label_column and collect_statistics only for ARFF/CSV files (LabelColumn::None keeps every column as a feature)
+template <std::floating_point FType>
+bool readDataset(const std::string& filename, Dataset<FType>& dataset, DataFormat format = DataFormat::Auto, const std::string& labels_filename = "", const LabelColumn label_column = LabelColumn::Last, const bool collect_statistics = false);
+
+// .npy -> Npy, .kmcache -> Cache, MNIST IDX file names -> Idx, everything else -> Delimited (ARFF/CSV), a trailing .gz is ignored
+DataFormat detectDataFormat(const std::string& filename);
+
+// parses the value of --format (auto, arff, csv, npy, idx, cache), returns false for an unknown name
+bool parseDataFormat(const std::string& name, DataFormat& format);
+
+// parses the value of --label_column (none, first, last), returns false for an unknown name
+bool parseLabelColumn(const std::string& name, LabelColumn& label_column);
+
+// Maps the whole file privately (copy on write), the mapping is released with the last copy of the pointer
+// Returns nullptr if the file can not be mapped
+std::shared_ptr<void> mapFile(const std::string& filename, std::size_t& file_size);
+
+#endif
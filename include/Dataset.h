@@ -0,0 +1,55 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <Aligned_Allocator.h>
+#include <Feature_Statistics.h>
+
+#include <vector>
+#include <memory>
+#include <concepts>
+#include <cstddef>
+
+// Dense data set in the flat layout used by the Parallel_KMeans engine
+// rows x cols values stored row major, every row is padded with zeros to stride = alignedRowSize<FType>(cols)
+// elements so that it starts on a BYTE_ALIGNMENT boundary
+template <std::floating_point FType>
+struct Dataset {
+
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+
+    std::vector<FType, AlignedAllocator<FType>> values;
+
+    // set if the rows are not stored in values but in memory owned by storage (e.g. a memory mapped file)
+    FType* view = nullptr;
+    std::shared_ptr<void> storage;
+
+    // empty if the file did not contain labels
+    std::vector<int> labels;
+
+    // statistics of the unscaled features, count is 0 if the loader did not collect them
+    FeatureStatistics statistics;
+
+    const FType* data() const { return view != nullptr ? view : values.data(); }
+    FType* data() { return view != nullptr ? view : values.data(); }
+
+    const FType* row(const std::size_t row_idx) const { return data() + row_idx * stride; }
+    FType* row(const std::size_t row_idx) { return data() + row_idx * stride; }
+
+    // copies the data into nested vectors, only needed for the implementations that do not use the flat layout
+    std::vector<std::vector<FType>> to_nested() const {
+
+        std::vector<std::vector<FType>> nested(rows);
+
+        for (std::size_t row_idx = 0; row_idx < rows; ++row_idx)
+        {
+            nested[row_idx].assign(row(row_idx), row(row_idx) + cols);
+        }
+
+        return nested;
+    }
+
+};
+
+#endif
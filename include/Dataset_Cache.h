@@ -0,0 +1,40 @@
+#ifndef DATASET_CACHE_H
+#define DATASET_CACHE_H
+
+#include <Dataset.h>
+#include <Data_Loader.h>
+
+#include <string>
+#include <string_view>
+#include <concepts>
+
+// Binary dataset cache (version 2)
+// A 128 byte header (magic, version, item size, rows, cols, stride, checksum, the size and modification time
+// of the source file, a stamp of the labels file and the label column of a delimited source) is followed by the padded row major values at a 64 byte aligned offset and the labels as int32.
+// The values can be stored as independently zlib compressed blocks which are decompressed in parallel
+constexpr std::string_view DATASET_CACHE_EXTENSION = ".kmcache";
+
+// Writes the data set to filename, source_filename, labels_filename and label_column are recorded so that a changed
+// source, a different labels file or another label column invalidates the cache. Returns false if the file can not be written
+template <std::floating_point FType>
+bool writeDatasetCache(const std::string& filename, const Dataset<FType>& dataset, const bool compress = false, const std::string& source_filename = "", const std::string& labels_filename = "", const LabelColumn label_column = LabelColumn::Last);
+
+// Reads a cache file, uncompressed caches are memory mapped and used without a copy
+// Returns false if the header or the sizes are not those of a valid cache for FType and this BYTE_ALIGNMENT
+// or if source_filename is given and the source changed since the cache was written or the cache was written with
+// another labels file than labels_filename (including none) or another label_column
+// The checksum is always written but only compared with verify_checksum because it reads every value and label
+template <std::floating_point FType>
+bool readDatasetCache(const std::string& filename, Dataset<FType>& dataset, const std::string& source_filename = "", const bool verify_checksum = false, const std::string& labels_filename = "", const LabelColumn label_column = LabelColumn::Last);
+
+// reads only the header of an uncompressed cache, e.g. to stream its rows with FileChunkSource
+bool readDatasetCacheLayout(const std::string& filename, BinaryLayout& layout);
+
+// Loads filename + DATASET_CACHE_EXTENSION if it is up to date, otherwise reads filename with readDataset
+// and writes the cache next to it for the next run, collect_statistics is passed to readDataset and the
+// statistics are stored in the cache if they were collected. verify_checksum also checks the checksum of
+// the cache that is loaded (the cache next to the source or a cache given as filename)
+template <std::floating_point FType>
+bool readDatasetCached(const std::string& filename, Dataset<FType>& dataset, const DataFormat format = DataFormat::Auto, const std::string& labels_filename = "", const bool compress_cache = false, const LabelColumn label_column = LabelColumn::Last, const bool collect_statistics = false, const bool verify_checksum = false);
+
+#endif
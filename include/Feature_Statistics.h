@@ -0,0 +1,35 @@
+#ifndef FEATURE_STATISTICS_H
+#define FEATURE_STATISTICS_H
+
+#include <vector>
+#include <concepts>
+#include <cstddef>
+
+// Per feature count, mean, sum of squared deviations (m2), min and max of a data set
+// Partial statistics of disjoint sets of rows are combined with merge (Chan et al.) so every thread
+// or parsed block can accumulate its own rows and the results are merged in a fixed order
+struct FeatureStatistics {
+
+    std::size_t count = 0;
+
+    std::vector<double> mean;
+    std::vector<double> m2;
+    std::vector<double> min;
+    std::vector<double> max;
+
+    std::size_t cols() const { return mean.size(); }
+
+    // population variance of every feature
+    std::vector<double> variance() const;
+
+    // adds rows x n_cols values with stride elements between the rows, the rows are taken in small blocks
+    // whose mean and m2 are computed while the block is in the L1 cache and then merged
+    template <std::floating_point FType>
+    void accumulate(const FType* data, const std::size_t rows, const std::size_t n_cols, const std::size_t stride);
+
+    // adds the statistics of other rows with the same number of features
+    void merge(const FeatureStatistics& other);
+
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef FILE_CHUNK_SOURCE_H
+#define FILE_CHUNK_SOURCE_H
+
+#include <Chunk_Source.h>
+#include <Data_Loader.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <concepts>
+
+// Streams the rows of a .npy file or an uncompressed .kmcache file with pread for the out of core fit
+// Files that already store padded FType rows are read straight into the chunk buffer, all others are
+// read into a staging buffer and converted row by row
+template <std::floating_point FType>
+class FileChunkSource : public ChunkSource<FType> {
+
+public:
+
+    FileChunkSource() = default;
+    ~FileChunkSource();
+
+    FileChunkSource(const FileChunkSource&) = delete;
+    FileChunkSource& operator=(const FileChunkSource&) = delete;
+
+    // with DataFormat::Auto the format is taken from the extension, returns false if the file can not be streamed
+    bool open(const std::string& filename, const DataFormat format = DataFormat::Auto);
+
+    std::size_t rows() const override { return layout.rows; }
+    std::size_t cols() const override { return layout.cols; }
+    bool readRows(const std::size_t first_row, const std::size_t n_rows, FType* buffer) const override;
+
+private:
+
+    int file_descriptor = -1;
+    BinaryLayout layout;
+    mutable std::vector<char> staging;
+
+    bool readBytes(char* buffer, std::size_t size, std::size_t offset) const;
+
+};
+
+// Opens a sequential row stream over a .npy, uncompressed .kmcache or ARFF/CSV (plain or gzipped) file
+// label_column is the column of an ARFF/CSV file that is skipped. Returns nullptr if the file can not be opened
+// or the format can not be streamed
+template <std::floating_point FType>
+std::unique_ptr<RowStream<FType>> openRowStream(const std::string& filename, const DataFormat format = DataFormat::Auto, const LabelColumn label_column = LabelColumn::Last);
+
+#endif
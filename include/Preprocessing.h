@@ -0,0 +1,41 @@
+#ifndef PREPROCESSING_H
+#define PREPROCESSING_H
+
+#include <Dataset.h>
+#include <Feature_Statistics.h>
+
+#include <string>
+#include <concepts>
+#include <cstddef>
+
+// Standardize: (x - mean) / standard deviation per feature
+// MinMax: (x - min) / (max - min) per feature, so every feature is in [0, 1]
+// L2: every row is divided by its euclidean norm, needs no statistics
+// features without spread (variance 0 or max == min) become 0
+enum class Scaling { None, Standardize, MinMax, L2 };
+
+// statistics of rows x cols values with stride elements between the rows in one parallel pass over the data
+// every thread accumulates a contiguous range of rows and the partial statistics are merged in thread order
+template <std::floating_point FType>
+FeatureStatistics computeFeatureStatistics(const FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride);
+
+// scales the rows in place in one parallel pass, statistics is only used by Standardize and MinMax
+// the padding after the cols values of a row is not touched and stays zero
+template <std::floating_point FType>
+void applyScaling(FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, const Scaling scaling, const FeatureStatistics& statistics);
+
+// true for Standardize and MinMax, the caller passes it as collect_statistics to the loader so the
+// statistics are only accumulated while parsing if the scaling uses them
+bool needsStatistics(const Scaling scaling);
+
+// scales the data set in place, the statistics are only computed if the loader did not already
+// collect them while the data was read (delimited files read with collect_statistics and the binary caches
+// written from them), dataset.statistics keeps the statistics of the unscaled data so the same scaling can be
+// applied to new data
+template <std::floating_point FType>
+bool scaleDataset(Dataset<FType>& dataset, const Scaling scaling);
+
+// parses the value of --scaling (none, standard, minmax, l2), returns false for an unknown name
+bool parseScaling(const std::string& name, Scaling& scaling);
+
+#endif
@@ -57,11 +57,11 @@ FType process(const FType*& new_data_ptr, const FType*& new_centroids_ptr, const
         }
 
         
-        __m128d low = _mm256_castpd256_pd128(sum_vec); // [a0, a1, a2, a3]
-        __m128d high = _mm256_extractf128_pd(sum_vec, 1); // [a4, a5, a6, a7]
-        __m128d sum_128 = _mm_add_pd(low, high); // [(a0 + a4), (a1+ a5), (a2 + a6), (a3 + a7)]
-        sum_128 = _mm_hadd_pd(sum_128, sum_128); // [(a0 + a4 + a1 + a5), (a2 + a6 + a3 + a7), X, X] X = duplicate
-        sum_128 = _mm_hadd_pd(sum_128, sum_128); // [(a0 + a4 +a1 +a5 +a2 + a6+ a3+ a7), X, X, X]
+        __m128d low = _mm256_castpd256_pd128(sum_vec); // [a0, a1]
+        __m128d high = _mm256_extractf128_pd(sum_vec, 1); // [a2, a3]
+        __m128d sum_128 = _mm_add_pd(low, high); // [(a0 + a2), (a1 + a3)]
+        // a 128 bit vector holds only two doubles, a single hadd already sums them (a second one would double the sum)
+        sum_128 = _mm_hadd_pd(sum_128, sum_128); // [(a0 + a2 + a1 + a3), X] X = duplicate
         FType distance =_mm_cvtsd_f64(sum_128); // extract the first element which holds the sum of all values in the originial sum_vec
 
         // add now the remaining elements to the sum 
@@ -142,6 +142,27 @@ FType process(const FType*& new_data_ptr, const FType*& new_centroids_ptr, const
 }
 
 
+// Squared euclidean distance between two rows, uses the custom SIMD kernels if they are enabled
+// and otherwise a loop that is left to the compiler to vectorize
+template <typename FType, typename IType>
+inline FType squaredDistance(const FType* first_ptr, const FType* second_ptr, const IType cols){
+
+    #if defined(SIMD_256) || defined(SIMD_512)
+    return process(first_ptr, second_ptr, cols);
+    #else
+    FType distance = 0;
+
+    #pragma omp simd reduction(+: distance)
+    for (IType col_idx = 0; col_idx < cols; ++col_idx)
+    {
+        FType diff = first_ptr[col_idx] - second_ptr[col_idx];
+        distance += diff * diff;
+    }
+
+    return distance;
+    #endif
+}
+
 #endif
 
 // Implementation wihtout splitting the sum_vector at the beginning
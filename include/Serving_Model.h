@@ -0,0 +1,76 @@
+#ifndef SERVING_MODEL_H
+#define SERVING_MODEL_H
+
+#include <Cont_Mem_Parallel_KMeans.h>
+#include <Aligned_Allocator.h>
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include <concepts>
+
+// Serves predict from any number of threads while new centroids are published, e.g. by a background refit
+// The centroids are copied into immutable snapshots with their precomputed squared norms, the current snapshot
+// is reached through an atomic pointer. Readers never lock or wait: they announce themselves on a counter of the
+// current epoch, load the pointer and leave. publish swaps in the new snapshot, advances the epoch twice and
+// frees the old snapshot once the readers of both epoch counters are gone (read copy update)
+template <std::floating_point FType>
+class ServingModel {
+
+public:
+
+    ServingModel() = default;
+    ~ServingModel();
+
+    ServingModel(const ServingModel&) = delete;
+    ServingModel& operator=(const ServingModel&) = delete;
+
+    // copies the centroids of a fitted model into a new snapshot and swaps it in, returns false if the model has no centroids
+    // concurrent publishes are serialized, the call returns once the previous snapshot is freed
+    bool publish(const Parallel_KMeans<FType>& model);
+
+    // labels and optionally the euclidean distances of rows of cols values with stride elements between the rows,
+    // computed against one snapshot even if a publish happens at the same time. Batches of at least
+    // SERVING_PARALLEL_ROWS rows are split over OpenMP threads, smaller ones stay on the calling thread
+    // returns false if nothing was published yet or cols does not match the published centroids
+    bool predict(const FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, int* labels, FType* distances = nullptr) const;
+
+    // number of publishes so far, 0 before the first one
+    std::uint64_t version() const;
+
+    static constexpr std::size_t SERVING_PARALLEL_ROWS = 4096;
+
+private:
+
+    struct Snapshot {
+
+        int n_cluster = 0;
+        std::size_t n_features = 0;
+        std::size_t row_stride = 0;
+        std::uint64_t version = 0;
+
+        std::vector<FType, AlignedAllocator<FType>> centroids;
+        std::vector<FType> norms;
+
+    };
+
+    // readers spread over the stripes so they do not all write the same cache line
+    static constexpr std::size_t READER_STRIPES = 16;
+
+    struct alignas(64) ReaderCounter {
+        std::atomic<std::size_t> count{0};
+    };
+
+    std::atomic<const Snapshot*> current{nullptr};
+    std::atomic<std::uint64_t> epoch{0};
+    mutable ReaderCounter readers[2][READER_STRIPES];
+    std::mutex publish_mutex;
+
+    std::atomic<std::size_t>& readerCounter() const;
+    void waitForReaders(const std::size_t parity) const;
+
+};
+
+#endif
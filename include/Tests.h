@@ -6,6 +6,25 @@
 #include <vector>
 
 void CheckLabels();
+#ifdef USE_CONT_MEM
+// fits the same data through the dense and the CSR path, returns false if the labels or the inertia differ
+bool CheckSparse();
+// fits the same data in deterministic mode with 1, 2, 3 and all OpenMP threads and on the thread pool,
+// returns false if the centroids, labels, inertia or iterations are not bitwise identical
+bool CheckDeterministic();
+// resumes a deterministic fit from a checkpoint written before it converged,
+// returns false if the resumed fit does not end with the centroids and iterations of the uninterrupted fit
+bool CheckResume();
+// returns false if the nearest centroid of predictTopK is not the label and distance of predict
+bool CheckTopK();
+// returns false if the distances of transform (squared and not) differ from squaredDistance beyond rounding
+bool CheckTransform();
+// writes float32 and float64 .npy files and returns false if readNpy does not read back the same values
+bool CheckNpy();
+// writes uncompressed and compressed .kmcache files and returns false if they are not read back unchanged
+// or if a corrupted file passes the checksum when it is verified
+bool CheckDatasetCache();
+#endif
 template <typename FType>
 void CheckData(std::vector<std::vector<FType>>& data);
 
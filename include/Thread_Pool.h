@@ -0,0 +1,105 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstddef>
+#include <type_traits>
+#include <functional>
+
+// Work stealing thread pool shared by all models of the process, an alternative to an OpenMP team per parallel region
+// The number of threads is capped once for the whole process, so models that run at the same time (e.g. from several
+// Python threads) share the same workers instead of starting a team each. Idle workers join the running loops in turn
+class ThreadPool {
+
+public:
+
+    // the pool of the process, created on first use with KMEANS_POOL_THREADS threads or one per hardware thread
+    static ThreadPool& shared();
+
+    // n_threads counts the calling thread of a loop, so n_threads - 1 workers are started
+    explicit ThreadPool(const std::size_t n_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of threads that can work on one loop at the same time, the workers and the calling thread
+    std::size_t slots() const;
+
+    // Calls body(first, last, slot) on disjoint chunks of about grain iterations that cover [0, n)
+    // slot < slots() is unique among the threads working on the loop at the same time so it can index per thread
+    // buffers, a thread can get several chunks with the same slot. The chunks are split evenly over the slots and a
+    // thread without chunks left steals half of the remaining chunks of another slot, so uneven chunks are balanced
+    // The calling thread works on the loop as well and the call returns once every chunk is done
+    template <typename Body>
+    void parallelFor(const std::size_t n, const std::size_t grain, Body&& body) {
+
+        auto call = [](void* context, const std::size_t first, const std::size_t last, const std::size_t slot) {
+            (*static_cast<std::remove_reference_t<Body>*>(context))(first, last, slot);
+        };
+
+        run(n, grain, call, &body);
+    }
+
+private:
+
+    using ChunkFunction = void (*)(void* context, const std::size_t first, const std::size_t last, const std::size_t slot);
+
+    struct Loop;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    // loops that may still have chunks, the workers pick them round robin
+    std::vector<std::shared_ptr<Loop>> loops;
+    std::size_t next_loop = 0;
+    bool stopping = false;
+
+    void run(const std::size_t n, const std::size_t grain, ChunkFunction function, void* context);
+    void workerLoop();
+    std::shared_ptr<Loop> nextLoop();
+
+};
+
+// One long lived thread that runs the jobs it is handed one after the other, used to overlap the reads or writes of
+// a streaming loop with its computation without starting a thread per step. With two buffers the loop hands the
+// job for one buffer to the thread and works on the other, wait is the handoff of the buffer back to the loop
+class BackgroundThread {
+
+public:
+
+    BackgroundThread();
+    ~BackgroundThread();
+
+    BackgroundThread(const BackgroundThread&) = delete;
+    BackgroundThread& operator=(const BackgroundThread&) = delete;
+
+    // starts job on the thread, the job that was submitted before must have been waited for
+    void submit(std::function<bool()> job);
+
+    // waits until the submitted job is done and returns its result, true if no job is pending
+    bool wait();
+
+private:
+
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    std::function<bool()> pending_job;
+    bool running = false;
+    bool result = true;
+    bool stopping = false;
+
+    // started last, after the state it uses is initialized
+    std::thread thread;
+
+    void threadLoop();
+
+};
+
+#endif
@@ -19,49 +19,12 @@
 #include <cstring>
 #include <KMeans.h>
 #include <omp.h>
+#include <tuple>
+#include <string>
+#include <memory>
 
 
 
-template <typename FType> 
-void CenterImages(std::vector<std::vector<FType>>& data, int image_size){
-
-    const std::size_t cols = data.empty() ? 0 : data[0].size();
-    float pixel_average = 0.0; 
-    std::size_t total_pixel_values = image_size * data.size();
-    double pixel_sum = 0;
-    
-    #pragma omp parallel for collapse(2) default(none) shared(data, cols) reduction( +: pixel_sum)
-    for (std::size_t image = 0; image < data.size(); ++image)
-    {
-        for (std::size_t col_idx = 0; col_idx < cols; ++col_idx)
-        {
-            pixel_sum += data[image][col_idx];
-        }
-    }
-
-    if (total_pixel_values > 0) {
-        pixel_average = pixel_sum / total_pixel_values;
-    }
-    else
-    {
-        std::cout << "Total Pixel Values <= 0 check the data" << std::endl;
-    }
-
-    // modify the data and subtract the average from all the pixel values
-
-    #pragma omp parallel for collapse(2) default(none) shared(data, cols, pixel_average) 
-    for (std::size_t image = 0; image < data.size(); ++image)
-    {
-        for (std::size_t col_idx = 0; col_idx < cols; ++col_idx)
-        {
-            data[image][col_idx] /= pixel_average;
-        }
-    }
-
-
-}
-
-
 template <typename FType>
 std::pair<std::vector<std::vector<FType>>, std::vector<int>> GenerateTestData(int n, int cols, int n_cluster, double mean, double stddev) {
 
@@ -150,30 +113,93 @@ std::tuple<std::vector<double>, std::vector<int>, double, double, double> TimeKM
 
 }
 
-template <typename FType, typename IType = std::size_t>
+// settings of the flat implementation that are applied to every timed fit
+struct FitOptions {
+
+    bool deterministic = false;
+
+    // run the parallel loops on the shared work stealing thread pool instead of OpenMP teams
+    bool thread_pool = false;
+
+    // start every fit from the centroids of init_model or continue the fit of the checkpoint resume_checkpoint
+    std::string init_model;
+    std::string resume_checkpoint;
+
+    // save the last fit and write checkpoints while fitting
+    std::string save_model;
+    std::string checkpoint_file;
+    int checkpoint_every = 0;
+    double checkpoint_seconds = 0;
+
+};
+
+// Data is either nested vectors or, for the flat implementation, a Dataset in the padded layout
+template <typename FType, typename IType = std::size_t, typename Data = std::vector<std::vector<FType>>>
 std::tuple<std::vector<double>, std::vector<int>, double, double, double> TimeParallelKMeans(
     const int n_cluster, 
     const int max_iter, 
     const double tol, 
     const int seed,  
-    int iterations, const std::vector<std::vector<FType>>& data){
+    int iterations, const Data& data,
+    [[maybe_unused]] const FitOptions& options = FitOptions{}){
 
     std::vector<double> KMeans_timings(iterations, 0.0);
     std::vector<int> KMeans_iterations(iterations, 0);
     std::cout << "Start timing Parallel KMeans for " << iterations << " Iterations" << std::endl;
 
+    #ifdef USE_CONT_MEM
+    std::unique_ptr<Parallel_KMeans<FType, IType>> initial_model;
+    if (!options.init_model.empty())
+    {
+        initial_model = Parallel_KMeans<FType, IType>::load(options.init_model);
+    }
+    #endif
+
     for (int iteration = 0; iteration < iterations; ++iteration)
     {
-        Parallel_KMeans<FType, IType> kmeans(n_cluster, max_iter, tol, seed);
+        std::unique_ptr<Parallel_KMeans<FType, IType>> kmeans;
+
+        #ifdef USE_CONT_MEM
+        // a resumed fit keeps the parameters of the checkpoint
+        if (!options.resume_checkpoint.empty())
+        {
+            kmeans = Parallel_KMeans<FType, IType>::resume(options.resume_checkpoint);
+        }
+
+        if (!kmeans)
+        {
+            kmeans = std::make_unique<Parallel_KMeans<FType, IType>>(n_cluster, max_iter, tol, seed);
+            kmeans->deterministic = options.deterministic;
+        }
+
+        if (initial_model)
+        {
+            kmeans->warm_start = kmeans->setCentroids(initial_model->centroids.data(), initial_model->n_cluster, initial_model->n_features, initial_model->row_stride);
+        }
+
+        kmeans->checkpoint_file = options.checkpoint_file;
+        kmeans->checkpoint_every = options.checkpoint_every;
+        kmeans->checkpoint_seconds = options.checkpoint_seconds;
+        kmeans->parallel_backend = options.thread_pool ? ParallelBackend::ThreadPool : ParallelBackend::OpenMP;
+        #else
+        kmeans = std::make_unique<Parallel_KMeans<FType, IType>>(n_cluster, max_iter, tol, seed);
+        #endif
         auto start = std::chrono::high_resolution_clock::now();
 
-        kmeans.fit(data);
+        kmeans->fit(data);
 
         auto end = std::chrono::high_resolution_clock::now();
    
         std::chrono::duration<double, std::milli> elapsed = end - start;
         KMeans_timings[iteration] = elapsed.count();
-        KMeans_iterations[iteration] = kmeans.n_iter;
+        KMeans_iterations[iteration] = kmeans->n_iter;
+
+        #ifdef USE_CONT_MEM
+        if (!options.save_model.empty() && iteration == iterations - 1)
+        {
+            kmeans->save(options.save_model);
+        }
+        #endif
     }
 
     double KMeans_average = 0.0;
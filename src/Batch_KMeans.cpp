@@ -0,0 +1,277 @@
+#include <Batch_KMeans.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <omp.h>
+
+namespace {
+
+// the rows of a group are not padded or aligned, so the aligned SIMD kernels of the engine can not be used
+template <std::floating_point FType>
+inline FType rowDistance(const FType* row_ptr, const FType* centroid_ptr, const std::size_t cols) {
+
+    FType distance = 0;
+
+    #pragma omp simd reduction(+: distance)
+    for (std::size_t col = 0; col < cols; ++col)
+    {
+        const FType diff = row_ptr[col] - centroid_ptr[col];
+        distance += diff * diff;
+    }
+
+    return distance;
+}
+
+// Lloyd iterations of one group, writes its centroids and labels and returns the number of iterations
+// with team set the rows are split over all threads of one parallel region, otherwise the calling thread does everything
+template <std::floating_point FType>
+int fitGroup(const FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, const int k, FType* centroids, int* labels, double& inertia, std::mt19937& gen, const BatchOptions& options, const bool team) {
+
+    std::uniform_int_distribution<std::size_t> dist{0, rows - 1};
+
+    for (int centroid = 0; centroid < k; ++centroid)
+    {
+        const FType* row_ptr = data + dist(gen) * stride;
+        std::copy(row_ptr, row_ptr + cols, centroids + centroid * cols);
+    }
+
+    const int n_threads = team ? omp_get_max_threads() : 1;
+    std::vector<double> sums(n_threads * k * cols);
+    std::vector<std::size_t> counts(n_threads * k);
+    std::vector<FType> new_centroids(k * cols);
+
+    // assigns the rows [first_row, last_row) and adds them to the sums of the thread, returns their inertia
+    auto assign_rows = [&](const std::size_t first_row, const std::size_t last_row, const int thread) {
+
+        double* thread_sums = &sums[thread * k * cols];
+        std::size_t* thread_counts = &counts[thread * k];
+        std::fill(thread_sums, thread_sums + k * cols, 0);
+        std::fill(thread_counts, thread_counts + k, 0);
+        double rows_inertia = 0;
+
+        for (std::size_t row = first_row; row < last_row; ++row)
+        {
+            const FType* row_ptr = data + row * stride;
+            FType min_distance = std::numeric_limits<FType>::max();
+            int best_centroid = 0;
+
+            for (int centroid = 0; centroid < k; ++centroid)
+            {
+                const FType distance = rowDistance(row_ptr, centroids + centroid * cols, cols);
+
+                if (distance < min_distance)
+                {
+                    min_distance = distance;
+                    best_centroid = centroid;
+                }
+            }
+
+            labels[row] = best_centroid;
+            rows_inertia += std::sqrt(min_distance);
+            thread_counts[best_centroid]++;
+
+            double* sum_ptr = thread_sums + best_centroid * cols;
+
+            #pragma omp simd
+            for (std::size_t col = 0; col < cols; ++col)
+            {
+                sum_ptr[col] += row_ptr[col];
+            }
+        }
+
+        return rows_inertia;
+    };
+
+    int iter = options.max_iter;
+    bool converged = false;
+    std::vector<double> thread_inertia(n_threads, 0);
+
+    // a team group opens one parallel region for all of its iterations, the rows are split over the threads that
+    // actually run (nested calls, OMP_DYNAMIC or a thread limit can give fewer than asked for) and the centroid
+    // update runs on one of them between the assignments. A single group is a region of one thread
+    #pragma omp parallel default(none) shared(data, rows, cols, stride, k, centroids, inertia, gen, dist, options, sums, counts, new_centroids, thread_inertia, assign_rows, iter, converged) num_threads(n_threads) if(team)
+    {
+        const int thread = omp_get_thread_num();
+        const int n_team = omp_get_num_threads();
+        const std::size_t first_row = rows * thread / n_team;
+        const std::size_t last_row = rows * (thread + 1) / n_team;
+
+        for (int iteration = 1; iteration < options.max_iter + 1; ++iteration)
+        {
+            thread_inertia[thread] = assign_rows(first_row, last_row, thread);
+
+            #pragma omp barrier
+
+            #pragma omp single
+            {
+                // the partial sums are merged in thread order, a team of another size can round differently
+                inertia = thread_inertia[0];
+
+                for (int team_thread = 1; team_thread < n_team; ++team_thread)
+                {
+                    inertia += thread_inertia[team_thread];
+
+                    for (std::size_t value = 0; value < k * cols; ++value)
+                    {
+                        sums[value] += sums[team_thread * k * cols + value];
+                    }
+
+                    for (int centroid = 0; centroid < k; ++centroid)
+                    {
+                        counts[centroid] += counts[team_thread * k + centroid];
+                    }
+                }
+
+                converged = true;
+
+                for (int centroid = 0; centroid < k; ++centroid)
+                {
+                    FType* new_centroid_ptr = &new_centroids[centroid * cols];
+
+                    // an empty cluster is moved to a random row like in Parallel_KMeans
+                    if (counts[centroid] == 0)
+                    {
+                        const FType* row_ptr = data + dist(gen) * stride;
+                        std::copy(row_ptr, row_ptr + cols, new_centroid_ptr);
+                    }
+                    else
+                    {
+                        const double inverse_count = 1.0 / counts[centroid];
+
+                        for (std::size_t col = 0; col < cols; ++col)
+                        {
+                            new_centroid_ptr[col] = sums[centroid * cols + col] * inverse_count;
+                        }
+                    }
+
+                    if (converged && std::sqrt(static_cast<double>(rowDistance(centroids + centroid * cols, new_centroid_ptr, cols))) >= options.tol)
+                    {
+                        converged = false;
+                    }
+                }
+
+                if (converged)
+                {
+                    iter = iteration;
+                }
+                else
+                {
+                    std::copy(new_centroids.begin(), new_centroids.end(), centroids);
+                }
+            }
+
+            // the implicit barrier of single makes converged the same for every thread
+            if (converged)
+            {
+                break;
+            }
+        }
+    }
+
+    return iter;
+}
+
+}
+
+template <std::floating_point FType>
+bool fitBatch(const FType* data,
+              const std::size_t cols,
+              const std::size_t stride,
+              const std::size_t* row_offsets,
+              const std::size_t n_groups,
+              const int* n_clusters,
+              BatchResult<FType>& result,
+              const BatchOptions& options) {
+
+    if (cols == 0 || stride < cols || options.max_iter < 1)
+    {
+        std::cerr << "Error: Invalid batch shape or max_iter" << std::endl;
+        return false;
+    }
+
+    result.centroid_offsets.assign(n_groups + 1, 0);
+
+    for (std::size_t group = 0; group < n_groups; ++group)
+    {
+        if (row_offsets[group + 1] < row_offsets[group])
+        {
+            std::cerr << "Error: The row offsets of the groups must not decrease, group " << group << std::endl;
+            return false;
+        }
+
+        const std::size_t rows = row_offsets[group + 1] - row_offsets[group];
+
+        if (n_clusters[group] < 1 || static_cast<std::size_t>(n_clusters[group]) > rows)
+        {
+            std::cerr << "Error: Group " << group << " has " << rows << " rows and " << n_clusters[group] << " clusters" << std::endl;
+            return false;
+        }
+
+        result.centroid_offsets[group + 1] = result.centroid_offsets[group] + n_clusters[group];
+    }
+
+    const std::size_t total_rows = n_groups > 0 ? row_offsets[n_groups] - row_offsets[0] : 0;
+
+    result.centroids.assign(result.centroid_offsets[n_groups] * cols, 0);
+    result.labels.assign(total_rows, 0);
+    result.n_iter.assign(n_groups, 0);
+    result.inertia.assign(n_groups, 0);
+
+    const unsigned int seed = options.seed.value_or(std::random_device{}());
+
+    // large groups first with all threads, then the small ones a thread each, largest work first so the
+    // dynamic schedule does not end on one long group
+    std::vector<std::size_t> team_groups;
+    std::vector<std::size_t> single_groups;
+
+    for (std::size_t group = 0; group < n_groups; ++group)
+    {
+        const std::size_t rows = row_offsets[group + 1] - row_offsets[group];
+        (rows >= options.team_rows ? team_groups : single_groups).push_back(group);
+    }
+
+    auto work = [&](const std::size_t group) { return (row_offsets[group + 1] - row_offsets[group]) * n_clusters[group]; };
+    std::stable_sort(single_groups.begin(), single_groups.end(), [&](const std::size_t first, const std::size_t second) { return work(first) > work(second); });
+
+    auto fit_group = [&](const std::size_t group, const bool team) {
+
+        const std::size_t first_row = row_offsets[group];
+        std::seed_seq group_seed{seed, static_cast<unsigned int>(group), static_cast<unsigned int>(group >> 32)};
+        std::mt19937 gen(group_seed);
+
+        result.n_iter[group] = fitGroup(data + first_row * stride,
+                                        row_offsets[group + 1] - first_row,
+                                        cols,
+                                        stride,
+                                        n_clusters[group],
+                                        &result.centroids[result.centroid_offsets[group] * cols],
+                                        &result.labels[first_row - row_offsets[0]],
+                                        result.inertia[group],
+                                        gen,
+                                        options,
+                                        team);
+    };
+
+    for (const std::size_t group : team_groups)
+    {
+        fit_group(group, true);
+    }
+
+    const std::size_t n_single_groups = single_groups.size();
+
+    #pragma omp parallel for default(none) shared(n_single_groups, single_groups, fit_group) schedule(dynamic)
+    for (std::size_t index = 0; index < n_single_groups; ++index)
+    {
+        fit_group(single_groups[index], false);
+    }
+
+    return true;
+}
+
+template bool fitBatch<float>(const float* data, const std::size_t cols, const std::size_t stride, const std::size_t* row_offsets, const std::size_t n_groups, const int* n_clusters, BatchResult<float>& result, const BatchOptions& options);
+template bool fitBatch<double>(const double* data, const std::size_t cols, const std::size_t stride, const std::size_t* row_offsets, const std::size_t n_groups, const int* n_clusters, BatchResult<double>& result, const BatchOptions& options);
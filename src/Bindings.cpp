@@ -1,12 +1,24 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include "Cont_Mem_Parallel_KMeans.h" 
+#include "CSR_Matrix.h"
+#include "Batch_KMeans.h"
+#include "Serving_Model.h"
 
 #include <vector>
 #include <random>
 #include <iostream>
 #include <concepts>
 #include <optional>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
 
 namespace py = pybind11;
 
@@ -14,31 +26,694 @@ namespace py = pybind11;
 using ParallelKMeansDouble = Parallel_KMeans<double, std::size_t>;
 using ParallelKMeansFloat = Parallel_KMeans<float, std::size_t>;
 
+// Converts any scipy.sparse matrix into the CSR layout used by the engine
+// only indptr, indices and data are copied the matrix is never densified
+template <typename FType>
+CSR_Matrix<FType, std::size_t> ScipyToCSR(const py::object& matrix) {
+
+    py::object csr = matrix.attr("tocsr")();
+    py::tuple shape = csr.attr("shape").cast<py::tuple>();
+
+    auto indptr = py::array_t<std::size_t, py::array::c_style | py::array::forcecast>::ensure(csr.attr("indptr"));
+    auto indices = py::array_t<std::size_t, py::array::c_style | py::array::forcecast>::ensure(csr.attr("indices"));
+    auto values = py::array_t<FType, py::array::c_style | py::array::forcecast>::ensure(csr.attr("data"));
+
+    if (!indptr || !indices || !values)
+    {
+        throw std::invalid_argument("Expected a scipy.sparse matrix with indptr, indices and data arrays");
+    }
+
+    return CSR_Matrix<FType, std::size_t>(
+        shape[0].cast<std::size_t>(),
+        shape[1].cast<std::size_t>(),
+        std::vector<std::size_t>(indptr.data(), indptr.data() + indptr.size()),
+        std::vector<std::size_t>(indices.data(), indices.data() + indices.size()),
+        std::vector<FType>(values.data(), values.data() + values.size()));
+}
+
+// hands a vector over to NumPy without copying it, the array owns the vector through a capsule
+template <typename T>
+py::array_t<T> MoveToArray(std::vector<T>&& values, const std::vector<py::ssize_t>& shape) {
+
+    auto owner = new std::vector<T>(std::move(values));
+    py::capsule free_values(owner, [](void* ptr) { delete static_cast<std::vector<T>*>(ptr); });
+
+    return py::array_t<T>(shape, owner->data(), free_values);
+}
+
+// The labels and centroids are returned as arrays that own their values instead of views of the model: a refit with
+// another shape, partial_fit, set_centroids or the out of core fit reallocate the model's buffers, which would leave
+// a view pointing to freed memory. The copy is one pass over the buffer, no Python objects are created per value
+
+// labels_ of the last fit
+template <typename Model>
+py::array_t<int> LabelsArray(const Model& model) {
+
+    return MoveToArray(std::vector<int>(model.labels.begin(), model.labels.end()), {static_cast<py::ssize_t>(model.labels.size())});
+}
+
+// cluster_centers_ as (n_cluster, n_features), the padding of the centroid rows is dropped
+template <typename Model>
+auto CentroidsArray(const Model& model) {
+
+    using FType = typename decltype(model.centroids)::value_type;
+
+    const std::size_t rows = model.centroids.empty() ? 0 : model.n_cluster;
+    std::vector<FType> values(rows * model.n_features);
+
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        std::copy_n(&model.centroids[row * model.row_stride], model.n_features, &values[row * model.n_features]);
+    }
+
+    return MoveToArray(std::move(values), {static_cast<py::ssize_t>(rows), static_cast<py::ssize_t>(model.n_features)});
+}
+
+// replaces the centroids of a model by a (n_cluster, n_features) array, used with warm_start to refit from them
+template <typename Model, typename FType>
+void NumpyToCentroids(Model& model, const py::array_t<FType, py::array::c_style | py::array::forcecast>& new_centroids) {
+
+    if (new_centroids.ndim() != 2 || !model.setCentroids(new_centroids.data(), new_centroids.shape(0), new_centroids.shape(1), new_centroids.shape(1)))
+    {
+        throw std::invalid_argument("Expected the centroids as an array of shape (n_cluster, n_features)");
+    }
+}
+
+// true if the array holds FType values and the values of every row are next to each other
+template <typename FType>
+bool HasContiguousRows(const py::array& data) {
+
+    const py::ssize_t item_size = sizeof(FType);
+    return py::isinstance<py::array_t<FType>>(data) && data.strides(1) == item_size && data.strides(0) > 0 && data.strides(0) % item_size == 0;
+}
+
+// Rows of a 2D NumPy array as seen by the engine, owner keeps the array (or its converted copy) alive
+// so the rows can be read after the GIL is released
+template <typename FType>
+struct NumpyRows {
+
+    py::array owner;
+    const FType* data = nullptr;
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+
+};
+
+// an array of the engine's dtype whose rows are contiguous (C order or a slice of rows or columns) is passed as is
+// with its row stride, the engine reads it in place only if the rows have no padding (the columns after a column
+// slice are not zero) and otherwise repacks it once in parallel
+// any other array (other dtype, Fortran order) is converted once by NumPy, must be called with the GIL held
+template <typename FType>
+NumpyRows<FType> ReadRows(const py::array& data) {
+
+    if (data.ndim() != 2)
+    {
+        throw std::invalid_argument("Expected a 2D array of shape (n_samples, n_features)");
+    }
+
+    NumpyRows<FType> input;
+    input.rows = data.shape(0);
+    input.cols = data.shape(1);
+
+    if (HasContiguousRows<FType>(data))
+    {
+        input.owner = data;
+        input.data = static_cast<const FType*>(data.data());
+        input.stride = data.strides(0) / static_cast<py::ssize_t>(sizeof(FType));
+        return input;
+    }
+
+    auto converted = py::array_t<FType, py::array::c_style | py::array::forcecast>::ensure(data);
+    if (!converted)
+    {
+        throw std::invalid_argument("Expected an array of numbers");
+    }
+
+    input.data = converted.data();
+    input.stride = input.cols;
+    input.owner = std::move(converted);
+    return input;
+}
+
+// Fits on a 2D NumPy array through the buffer protocol instead of nested lists, see ReadRows
+// the GIL is released while the engine runs so other Python threads keep running
+template <typename FType, typename Model>
+void FitNumpy(Model& model, const py::array& data) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+
+    py::gil_scoped_release release;
+    model.fit(input.data, input.rows, input.cols, input.stride);
+}
+
+// Online update of the centroids with one batch of a 2D NumPy array, the batch is not kept by the model
+// returns the model like scikit-learn so calls can be chained
+template <typename FType, typename Model>
+Model& PartialFitNumpy(Model& model, const py::array& data) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+    bool updated;
+
+    {
+        py::gil_scoped_release release;
+        updated = model.partialFit(input.data, input.rows, input.cols, input.stride);
+    }
+
+    if (!updated)
+    {
+        throw std::invalid_argument("The batch does not match the centroids or the first batch has fewer rows than clusters");
+    }
+
+    return model;
+}
+
+// checks that an output argument of predict is a writeable C contiguous 1D array of rows values
+template <typename T>
+py::array_t<T> OutputArray(const py::object& output, const std::size_t rows, const char* name) {
+
+    if (!py::isinstance<py::array_t<T>>(output))
+    {
+        throw std::invalid_argument(std::string(name) + " must be a NumPy array of the matching dtype (int32 labels, distances of the model dtype)");
+    }
+
+    py::array_t<T> array = py::reinterpret_borrow<py::array_t<T>>(output);
+
+    if (array.ndim() != 1 || array.shape(0) != static_cast<py::ssize_t>(rows) || !array.writeable() || !(array.flags() & py::array::c_style))
+    {
+        throw std::invalid_argument(std::string(name) + " must be a writeable contiguous 1D array with one entry per row");
+    }
+
+    return array;
+}
+
+// Arrays predict writes into, the labels and the distances if they were asked for
+template <typename FType>
+struct PredictOutput {
+
+    py::array_t<int> labels;
+    py::array_t<FType> distances;
+    bool with_distances = false;
+
+    int* labels_ptr = nullptr;
+    FType* distances_ptr = nullptr;
+
+    // labels or (labels, distances)
+    py::object result() const {
+
+        if (with_distances)
+        {
+            return py::make_tuple(labels, distances);
+        }
+
+        return labels;
+    }
+
+};
+
+// The results are written straight into labels_out and distances_out if they are arrays, otherwise the labels
+// (and the distances if distances_out is True) go to new arrays, must be called with the GIL held
+template <typename FType>
+PredictOutput<FType> PredictOutputs(const std::size_t rows, const py::object& labels_out, const py::object& distances_out) {
+
+    PredictOutput<FType> output;
+    output.labels = labels_out.is_none() ? py::array_t<int>(static_cast<py::ssize_t>(rows)) : OutputArray<int>(labels_out, rows, "labels");
+    output.labels_ptr = output.labels.mutable_data();
+
+    output.with_distances = !distances_out.is_none() && !(py::isinstance<py::bool_>(distances_out) && !distances_out.cast<bool>());
+
+    if (output.with_distances)
+    {
+        output.distances = py::isinstance<py::bool_>(distances_out) ? py::array_t<FType>(static_cast<py::ssize_t>(rows)) : OutputArray<FType>(distances_out, rows, "distances");
+        output.distances_ptr = output.distances.mutable_data();
+    }
+
+    return output;
+}
+
+// Labels (and optionally the distances to the nearest centroid) of the rows of a 2D NumPy array, the data is read
+// in place like in FitNumpy and the GIL is released while the engine runs. Returns labels or (labels, distances)
+// if distances is True or an array
+template <typename FType, typename Model>
+py::object PredictNumpy(const Model& model, const py::array& data, const py::object& labels_out, const py::object& distances_out) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+    const PredictOutput<FType> output = PredictOutputs<FType>(input.rows, labels_out, distances_out);
+    bool predicted;
+
+    {
+        py::gil_scoped_release release;
+        predicted = model.predict(input.data, input.rows, input.cols, input.stride, output.labels_ptr, output.distances_ptr);
+    }
+
+    if (!predicted)
+    {
+        throw std::invalid_argument("The number of features does not match the fitted centroids");
+    }
+
+    return output.result();
+}
+
+// Distances of the rows of a 2D NumPy array to every centroid as a (n_samples, n_cluster) array, written straight
+// into out if it is a writeable array of the model dtype with contiguous rows, otherwise into a new array
+// squared keeps the squared distances, the GIL is released while the engine runs
+template <typename FType, typename Model>
+py::array_t<FType> TransformNumpy(const Model& model, const py::array& data, const py::object& out, const bool squared) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+    const py::ssize_t n_cluster = model.n_cluster;
+    py::array_t<FType> distances;
+
+    if (out.is_none())
+    {
+        distances = py::array_t<FType>({static_cast<py::ssize_t>(input.rows), n_cluster});
+    }
+    else
+    {
+        if (!py::isinstance<py::array_t<FType>>(out))
+        {
+            throw std::invalid_argument("out must be a NumPy array of the model dtype");
+        }
+
+        distances = py::reinterpret_borrow<py::array_t<FType>>(out);
+
+        if (distances.ndim() != 2 || distances.shape(0) != static_cast<py::ssize_t>(input.rows) || distances.shape(1) != n_cluster || !distances.writeable() || !HasContiguousRows<FType>(distances))
+        {
+            throw std::invalid_argument("out must be a writeable (n_samples, n_cluster) array with contiguous rows");
+        }
+    }
+
+    FType* distances_ptr = distances.mutable_data();
+    const std::size_t distance_stride = distances.strides(0) / static_cast<py::ssize_t>(sizeof(FType));
+    bool transformed;
+
+    {
+        py::gil_scoped_release release;
+        transformed = model.transform(input.data, input.rows, input.cols, input.stride, distances_ptr, distance_stride, squared);
+    }
+
+    if (!transformed)
+    {
+        throw std::invalid_argument("The number of features does not match the fitted centroids");
+    }
+
+    return distances;
+}
+
+// The m nearest centroids of every row of a 2D NumPy array and their distances, nearest first
+// returns (indices, distances) as two (n_samples, m) arrays, the GIL is released while the engine runs
+template <typename FType, typename Model>
+py::tuple PredictTopKNumpy(const Model& model, const py::array& data, const int m) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+    const std::vector<py::ssize_t> shape{static_cast<py::ssize_t>(input.rows), std::max(m, 0)};
+
+    py::array_t<int> indices(shape);
+    py::array_t<FType> distances(shape);
+    int* indices_ptr = indices.mutable_data();
+    FType* distances_ptr = distances.mutable_data();
+    bool predicted;
+
+    {
+        py::gil_scoped_release release;
+        predicted = model.predictTopK(input.data, input.rows, input.cols, input.stride, m, indices_ptr, distances_ptr);
+    }
+
+    if (!predicted)
+    {
+        throw std::invalid_argument("The number of features must match the fitted centroids and m must be between 1 and n_cluster");
+    }
+
+    return py::make_tuple(indices, distances);
+}
+
+// Handle of a fit or predict that runs on its own thread, returned by fit_async and predict_async
+// The work never touches Python objects, the arrays it reads and writes and the model are kept alive by keep_alive
+// until the handle is gone. The model must not be used by other calls until the work is done
+class AsyncTask {
+
+public:
+
+    AsyncTask(std::future<void> task, std::function<bool()> cancel_task, py::object result_value, py::tuple objects)
+        : work(task.share()), cancel_work(std::move(cancel_task)), value(std::move(result_value)), keep_alive(std::move(objects)) {}
+
+    AsyncTask(AsyncTask&&) = default;
+    AsyncTask(const AsyncTask&) = delete;
+    AsyncTask& operator=(const AsyncTask&) = delete;
+
+    // the thread must not outlive the memory it uses
+    ~AsyncTask() {
+
+        if (work.valid())
+        {
+            py::gil_scoped_release release;
+            work.wait();
+        }
+    }
+
+    bool done() const {
+
+        return work.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // waits without holding the GIL, raises TimeoutError if the work is not done after timeout seconds
+    // and the exception of the work if it failed
+    py::object result(const std::optional<double> timeout) {
+
+        bool ready = true;
+
+        {
+            py::gil_scoped_release release;
+
+            if (timeout)
+            {
+                ready = work.wait_for(std::chrono::duration<double>(*timeout)) == std::future_status::ready;
+            }
+            else
+            {
+                work.wait();
+            }
+        }
+
+        if (!ready)
+        {
+            PyErr_SetString(PyExc_TimeoutError, "The task is still running");
+            throw py::error_already_set();
+        }
+
+        work.get();
+        return value;
+    }
+
+    // asks the work to stop, a fit stops after the running iteration, returns false if nothing can be stopped
+    bool cancel() {
+
+        return !done() && cancel_work();
+    }
+
+private:
+
+    std::shared_future<void> work;
+    std::function<bool()> cancel_work;
+    py::object value;
+    py::tuple keep_alive;
+
+};
+
+// starts a fit on a NumPy array on another thread, the result of the handle is the model
+template <typename FType, typename Model>
+AsyncTask FitAsync(const py::object& self, const py::array& data) {
+
+    Model* model = self.cast<Model*>();
+    NumpyRows<FType> input = ReadRows<FType>(data);
+
+    // the fit is marked as running before the thread starts, a cancel that arrives earlier would be ignored
+    model->prepareFit();
+
+    std::future<void> work = std::async(std::launch::async, [model, data = input.data, rows = input.rows, cols = input.cols, stride = input.stride]() {
+        model->fit(data, rows, cols, stride);
+    });
+
+    return AsyncTask(std::move(work), [model]() { model->cancel(); return true; }, self, py::make_tuple(std::move(input.owner)));
+}
+
+// starts a predict on a NumPy array on another thread, the result of the handle is what predict returns
+// a predict is one pass over the data and can not be cancelled
+template <typename FType, typename Model>
+AsyncTask PredictAsync(const py::object& self, const py::array& data, const py::object& labels_out, const py::object& distances_out) {
+
+    const Model* model = self.cast<const Model*>();
+    NumpyRows<FType> input = ReadRows<FType>(data);
+    const PredictOutput<FType> output = PredictOutputs<FType>(input.rows, labels_out, distances_out);
+
+    std::future<void> work = std::async(std::launch::async, [model, input_data = input.data, rows = input.rows, cols = input.cols, stride = input.stride, labels = output.labels_ptr, distances = output.distances_ptr]() {
+        if (!model->predict(input_data, rows, cols, stride, labels, distances))
+        {
+            throw std::invalid_argument("The number of features does not match the fitted centroids");
+        }
+    });
+
+    return AsyncTask(std::move(work), []() { return false; }, output.result(), py::make_tuple(self, std::move(input.owner)));
+}
+
+// Fits one model per group of rows of a 2D array in one call, see fitBatch. offsets holds n_groups + 1 row offsets
+// and n_clusters is one number for all groups or one per group. Returns a dict with the packed centroids
+// (total clusters, n_features), centroid_offsets (n_groups + 1), labels (n_samples, relative to the group), n_iter and inertia
+template <typename FType>
+py::dict FitBatchNumpy(const py::array& data, const py::array_t<std::int64_t, py::array::c_style | py::array::forcecast>& offsets, const py::object& n_clusters, const BatchOptions& options) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+
+    if (offsets.ndim() != 1 || offsets.shape(0) < 1 || offsets.at(offsets.shape(0) - 1) > static_cast<std::int64_t>(input.rows))
+    {
+        throw std::invalid_argument("offsets must be a 1D array of n_groups + 1 row offsets into data");
+    }
+
+    const std::size_t n_groups = offsets.shape(0) - 1;
+    std::vector<std::size_t> row_offsets(n_groups + 1);
+
+    for (std::size_t group = 0; group <= n_groups; ++group)
+    {
+        if (offsets.at(group) < 0)
+        {
+            throw std::invalid_argument("offsets must not be negative");
+        }
+
+        row_offsets[group] = offsets.at(group);
+    }
+
+    std::vector<int> clusters;
+
+    if (py::isinstance<py::int_>(n_clusters))
+    {
+        clusters.assign(n_groups, n_clusters.cast<int>());
+    }
+    else
+    {
+        auto per_group = py::array_t<int, py::array::c_style | py::array::forcecast>::ensure(n_clusters);
+        if (!per_group || per_group.ndim() != 1 || static_cast<std::size_t>(per_group.shape(0)) != n_groups)
+        {
+            throw std::invalid_argument("n_clusters must be an int or a 1D array with one entry per group");
+        }
+
+        clusters.assign(per_group.data(), per_group.data() + n_groups);
+    }
+
+    BatchResult<FType> result;
+    bool fitted;
+
+    {
+        py::gil_scoped_release release;
+        fitted = fitBatch(input.data, input.cols, input.stride, row_offsets.data(), n_groups, clusters.data(), result, options);
+    }
+
+    if (!fitted)
+    {
+        throw std::invalid_argument("Invalid offsets or number of clusters, see the error output");
+    }
+
+    const py::ssize_t n_centroids = result.centroid_offsets.back();
+    const py::ssize_t n_labels = result.labels.size();
+
+    py::dict fitted_groups;
+    fitted_groups["centroids"] = MoveToArray(std::move(result.centroids), {n_centroids, static_cast<py::ssize_t>(input.cols)});
+    fitted_groups["centroid_offsets"] = MoveToArray(std::move(result.centroid_offsets), {static_cast<py::ssize_t>(n_groups + 1)});
+    fitted_groups["labels"] = MoveToArray(std::move(result.labels), {n_labels});
+    fitted_groups["n_iter"] = MoveToArray(std::move(result.n_iter), {static_cast<py::ssize_t>(n_groups)});
+    fitted_groups["inertia"] = MoveToArray(std::move(result.inertia), {static_cast<py::ssize_t>(n_groups)});
+
+    return fitted_groups;
+}
+
+// Labels (and optionally distances) of the rows of a 2D NumPy array against the snapshot published last
+// the GIL is released and the serving model takes no lock, so many Python threads can predict at the same time
+template <typename FType>
+py::object ServingPredictNumpy(const ServingModel<FType>& model, const py::array& data, const py::object& labels_out, const py::object& distances_out) {
+
+    const NumpyRows<FType> input = ReadRows<FType>(data);
+    const PredictOutput<FType> output = PredictOutputs<FType>(input.rows, labels_out, distances_out);
+    bool predicted;
+
+    {
+        py::gil_scoped_release release;
+        predicted = model.predict(input.data, input.rows, input.cols, input.stride, output.labels_ptr, output.distances_ptr);
+    }
+
+    if (!predicted)
+    {
+        throw std::invalid_argument("No model was published or the number of features does not match it");
+    }
+
+    return output.result();
+}
+
+// loads a model file or raises if it can not be read
+template <typename Model>
+std::unique_ptr<Model> LoadModel(const std::string& filename) {
+
+    std::unique_ptr<Model> model = Model::load(filename);
+    if (!model)
+    {
+        throw std::runtime_error("Cannot load the model " + filename);
+    }
+
+    return model;
+}
+
+// loads a checkpoint or raises if it can not be read
+template <typename Model>
+std::unique_ptr<Model> ResumeModel(const std::string& filename) {
+
+    std::unique_ptr<Model> model = Model::resume(filename);
+    if (!model)
+    {
+        throw std::runtime_error("Cannot resume from the checkpoint " + filename);
+    }
+
+    return model;
+}
+
 PYBIND11_MODULE(P_KMeansLib, m) {
+    // handle of fit_async and predict_async, result waits with the GIL released
+    py::class_<AsyncTask>(m, "AsyncTask")
+        .def("done", &AsyncTask::done)
+        .def("result", &AsyncTask::result, py::arg("timeout") = py::none())
+        .def("cancel", &AsyncTask::cancel);
+
+    // backend of the parallel loops of a model, ThreadPool caps the threads of all models at KMEANS_POOL_THREADS
+    py::enum_<ParallelBackend>(m, "ParallelBackend")
+        .value("OpenMP", ParallelBackend::OpenMP)
+        .value("ThreadPool", ParallelBackend::ThreadPool);
+
     // Binding the Parallel_KMeans class with double precision (double, std::size_t)
     py::class_<ParallelKMeansDouble>(m, "Parallel_KMeans_Double")
         .def(py::init<const int, const int, const double, std::optional<int>>())  // Expose the constructor
-        .def("fit", &ParallelKMeansDouble::fit)  // Bind the fit method
-        .def("predict", &ParallelKMeansDouble::predict)  // Bind the predict method
+        .def("fit", &FitNumpy<double, ParallelKMeansDouble>)  // NumPy arrays are read in place, see FitNumpy
+        .def("predict", &PredictNumpy<double, ParallelKMeansDouble>, py::arg("data"), py::arg("labels") = py::none(), py::arg("distances") = py::none())
+        .def("fit", py::overload_cast<const std::vector<std::vector<double>>&>(&ParallelKMeansDouble::fit), py::call_guard<py::gil_scoped_release>())  // Bind the fit method
+        .def("predict", py::overload_cast<const std::vector<std::vector<double>>&>(&ParallelKMeansDouble::predict), py::call_guard<py::gil_scoped_release>())  // Bind the predict method
+        .def("transform", &TransformNumpy<double, ParallelKMeansDouble>, py::arg("data"), py::arg("out") = py::none(), py::arg("squared") = false)  // (n_samples, n_cluster) distances
+        .def("predict_topk", &PredictTopKNumpy<double, ParallelKMeansDouble>, py::arg("data"), py::arg("m"))  // (indices, distances) of the m nearest centroids
+        .def("fit_sparse", [](ParallelKMeansDouble& self, const py::object& matrix) { const auto csr = ScipyToCSR<double>(matrix); py::gil_scoped_release release; self.fit(csr); })  // fit on a scipy.sparse matrix
+        .def("predict_sparse", [](ParallelKMeansDouble& self, const py::object& matrix) { const auto csr = ScipyToCSR<double>(matrix); py::gil_scoped_release release; return self.predict(csr); })
+        .def("fit_async", &FitAsync<double, ParallelKMeansDouble>)  // fit on another thread, returns an AsyncTask whose result is the model
+        .def("partial_fit", &PartialFitNumpy<double, ParallelKMeansDouble>, py::return_value_policy::reference)  // online update with one batch, see partial_fit_decay
+        .def("predict_async", &PredictAsync<double, ParallelKMeansDouble>, py::arg("data"), py::arg("labels") = py::none(), py::arg("distances") = py::none())
+        .def("cancel", &ParallelKMeansDouble::cancel)  // stops a running fit after its current iteration
+        .def_readonly("cancelled", &ParallelKMeansDouble::cancelled)
 
         .def_readonly("n_cluster", &ParallelKMeansDouble::n_cluster)
         .def_readonly("max_iter", &ParallelKMeansDouble::max_iter)
         .def_readonly("tol", &ParallelKMeansDouble::tol)
         .def_readonly("n_iter", &ParallelKMeansDouble::n_iter)
         .def_readonly("inertia", &ParallelKMeansDouble::inertia)
+        .def_readwrite("deterministic", &ParallelKMeansDouble::deterministic)
+        .def_readwrite("parallel_backend", &ParallelKMeansDouble::parallel_backend)  // ParallelBackend.ThreadPool shares the workers with the other models
+        .def_readwrite("partial_fit_decay", &ParallelKMeansDouble::partial_fit_decay)
+        .def_readwrite("reassignment_ratio", &ParallelKMeansDouble::reassignment_ratio)
+        .def_readwrite("reduction_memory_limit", &ParallelKMeansDouble::reduction_memory_limit)
+        .def_readwrite("centroid_tile_bytes", &ParallelKMeansDouble::centroid_tile_bytes)
+        .def_readwrite("warm_start", &ParallelKMeansDouble::warm_start)
+        .def_property_readonly("centroids", &CentroidsArray<ParallelKMeansDouble>)  // arrays that own a copy, they stay valid after a refit
+        .def_property_readonly("cluster_centers_", &CentroidsArray<ParallelKMeansDouble>)
+        .def_property_readonly("labels_", &LabelsArray<ParallelKMeansDouble>)
+        .def("set_centroids", [](ParallelKMeansDouble& self, const py::array_t<double, py::array::c_style | py::array::forcecast>& new_centroids) { NumpyToCentroids(self, new_centroids); })
+        .def("save", [](const ParallelKMeansDouble& self, const std::string& filename) { if (!self.save(filename)) throw std::runtime_error("Cannot save the model " + filename); })
+        .def_static("load", &LoadModel<ParallelKMeansDouble>)  // memory maps a model written by save
+        .def_static("resume", &ResumeModel<ParallelKMeansDouble>)  // continues the fit of a checkpoint with the next fit call
+        .def_readwrite("checkpoint_file", &ParallelKMeansDouble::checkpoint_file)
+        .def_readwrite("checkpoint_every", &ParallelKMeansDouble::checkpoint_every)
+        .def_readwrite("checkpoint_seconds", &ParallelKMeansDouble::checkpoint_seconds)
         .def_readonly("labels", &ParallelKMeansDouble::labels);
 
 
     py::class_<ParallelKMeansFloat>(m, "Parallel_KMeans_Float")
         .def(py::init<const int, const int, const float, std::optional<int>>())  // Expose the constructor
-        .def("fit", &ParallelKMeansFloat::fit)  // Bind the fit method
-        .def("predict", &ParallelKMeansFloat::predict)  // Bind the predict method
+        .def("fit", &FitNumpy<float, ParallelKMeansFloat>)  // NumPy arrays are read in place, see FitNumpy
+        .def("predict", &PredictNumpy<float, ParallelKMeansFloat>, py::arg("data"), py::arg("labels") = py::none(), py::arg("distances") = py::none())
+        .def("fit", py::overload_cast<const std::vector<std::vector<float>>&>(&ParallelKMeansFloat::fit), py::call_guard<py::gil_scoped_release>())  // Bind the fit method
+        .def("predict", py::overload_cast<const std::vector<std::vector<float>>&>(&ParallelKMeansFloat::predict), py::call_guard<py::gil_scoped_release>())  // Bind the predict method
+        .def("transform", &TransformNumpy<float, ParallelKMeansFloat>, py::arg("data"), py::arg("out") = py::none(), py::arg("squared") = false)  // (n_samples, n_cluster) distances
+        .def("predict_topk", &PredictTopKNumpy<float, ParallelKMeansFloat>, py::arg("data"), py::arg("m"))  // (indices, distances) of the m nearest centroids
+        .def("fit_sparse", [](ParallelKMeansFloat& self, const py::object& matrix) { const auto csr = ScipyToCSR<float>(matrix); py::gil_scoped_release release; self.fit(csr); })  // fit on a scipy.sparse matrix
+        .def("predict_sparse", [](ParallelKMeansFloat& self, const py::object& matrix) { const auto csr = ScipyToCSR<float>(matrix); py::gil_scoped_release release; return self.predict(csr); })
+        .def("fit_async", &FitAsync<float, ParallelKMeansFloat>)  // fit on another thread, returns an AsyncTask whose result is the model
+        .def("partial_fit", &PartialFitNumpy<float, ParallelKMeansFloat>, py::return_value_policy::reference)  // online update with one batch, see partial_fit_decay
+        .def("predict_async", &PredictAsync<float, ParallelKMeansFloat>, py::arg("data"), py::arg("labels") = py::none(), py::arg("distances") = py::none())
+        .def("cancel", &ParallelKMeansFloat::cancel)  // stops a running fit after its current iteration
+        .def_readonly("cancelled", &ParallelKMeansFloat::cancelled)
 
         .def_readonly("n_cluster", &ParallelKMeansFloat::n_cluster)
         .def_readonly("max_iter", &ParallelKMeansFloat::max_iter)
         .def_readonly("tol", &ParallelKMeansFloat::tol)
         .def_readonly("n_iter", &ParallelKMeansFloat::n_iter)
         .def_readonly("inertia", &ParallelKMeansFloat::inertia)
+        .def_readwrite("deterministic", &ParallelKMeansFloat::deterministic)
+        .def_readwrite("parallel_backend", &ParallelKMeansFloat::parallel_backend)  // ParallelBackend.ThreadPool shares the workers with the other models
+        .def_readwrite("partial_fit_decay", &ParallelKMeansFloat::partial_fit_decay)
+        .def_readwrite("reassignment_ratio", &ParallelKMeansFloat::reassignment_ratio)
+        .def_readwrite("reduction_memory_limit", &ParallelKMeansFloat::reduction_memory_limit)
+        .def_readwrite("centroid_tile_bytes", &ParallelKMeansFloat::centroid_tile_bytes)
+        .def_readwrite("warm_start", &ParallelKMeansFloat::warm_start)
+        .def_property_readonly("centroids", &CentroidsArray<ParallelKMeansFloat>)  // arrays that own a copy, they stay valid after a refit
+        .def_property_readonly("cluster_centers_", &CentroidsArray<ParallelKMeansFloat>)
+        .def_property_readonly("labels_", &LabelsArray<ParallelKMeansFloat>)
+        .def("set_centroids", [](ParallelKMeansFloat& self, const py::array_t<float, py::array::c_style | py::array::forcecast>& new_centroids) { NumpyToCentroids(self, new_centroids); })
+        .def("save", [](const ParallelKMeansFloat& self, const std::string& filename) { if (!self.save(filename)) throw std::runtime_error("Cannot save the model " + filename); })
+        .def_static("load", &LoadModel<ParallelKMeansFloat>)  // memory maps a model written by save
+        .def_static("resume", &ResumeModel<ParallelKMeansFloat>)  // continues the fit of a checkpoint with the next fit call
+        .def_readwrite("checkpoint_file", &ParallelKMeansFloat::checkpoint_file)
+        .def_readwrite("checkpoint_every", &ParallelKMeansFloat::checkpoint_every)
+        .def_readwrite("checkpoint_seconds", &ParallelKMeansFloat::checkpoint_seconds)
         .def_readonly("labels", &ParallelKMeansFloat::labels);
 
+    // thread safe predict with hot swapped centroids, publish the model of a finished refit to swap it in
+    py::class_<ServingModel<double>>(m, "Serving_Model_Double")
+        .def(py::init<>())
+        .def("publish", [](ServingModel<double>& self, const ParallelKMeansDouble& model) { py::gil_scoped_release release; return self.publish(model); })
+        .def("predict", &ServingPredictNumpy<double>, py::arg("data"), py::arg("labels") = py::none(), py::arg("distances") = py::none())
+        .def_property_readonly("version", &ServingModel<double>::version);
+
+    py::class_<ServingModel<float>>(m, "Serving_Model_Float")
+        .def(py::init<>())
+        .def("publish", [](ServingModel<float>& self, const ParallelKMeansFloat& model) { py::gil_scoped_release release; return self.publish(model); })
+        .def("predict", &ServingPredictNumpy<float>, py::arg("data"), py::arg("labels") = py::none(), py::arg("distances") = py::none())
+        .def_property_readonly("version", &ServingModel<float>::version);
+
+    // fits the engine that matches the dtype of the array, float32 data uses the float engine and everything
+    // else the double engine, so the data is never converted to the other floating point type
+    m.def("fit", [](const py::array& data, const int n_cluster, const int max_iter, const double tol, std::optional<int> seed) -> py::object {
+
+        if (py::isinstance<py::array_t<float>>(data))
+        {
+            auto model = std::make_unique<ParallelKMeansFloat>(n_cluster, max_iter, tol, seed);
+            FitNumpy<float>(*model, data);
+            return py::cast(std::move(model));
+        }
+
+        auto model = std::make_unique<ParallelKMeansDouble>(n_cluster, max_iter, tol, seed);
+        FitNumpy<double>(*model, data);
+        return py::cast(std::move(model));
+
+    }, py::arg("data"), py::arg("n_cluster"), py::arg("max_iter") = 300, py::arg("tol") = 1e-4, py::arg("seed") = py::none());
+
+    // one model per group of rows in a single call, float32 data is fitted in float and everything else in double
+    m.def("fit_batch", [](const py::array& data, const py::array_t<std::int64_t, py::array::c_style | py::array::forcecast>& offsets, const py::object& n_clusters,
+                          const int max_iter, const double tol, std::optional<int> seed, const std::size_t team_rows) -> py::dict {
+
+        BatchOptions options;
+        options.max_iter = max_iter;
+        options.tol = tol;
+        options.seed = seed;
+        options.team_rows = team_rows;
+
+        if (py::isinstance<py::array_t<float>>(data))
+        {
+            return FitBatchNumpy<float>(data, offsets, n_clusters, options);
+        }
+
+        return FitBatchNumpy<double>(data, offsets, n_clusters, options);
+
+    }, py::arg("data"), py::arg("offsets"), py::arg("n_clusters"), py::arg("max_iter") = 300, py::arg("tol") = 1e-4, py::arg("seed") = py::none(), py::arg("team_rows") = BatchOptions{}.team_rows);
+
 }
\ No newline at end of file
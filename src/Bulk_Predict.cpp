@@ -0,0 +1,168 @@
+#include <Bulk_Predict.h>
+#include <Cont_Mem_Parallel_KMeans.h>
+#include <Chunk_Source.h>
+#include <Aligned_Allocator.h>
+#include <Thread_Pool.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <charconv>
+#include <algorithm>
+
+// the streaming predict needs the flat array implementation of Parallel_KMeans
+#ifdef USE_CONT_MEM
+
+namespace {
+
+template <std::floating_point FType>
+struct PredictionWriter {
+
+    const PredictionFormat format;
+    const bool write_distances;
+    std::ofstream labels_file;
+    std::ofstream distances_file;
+    std::vector<char> text;
+
+    PredictionWriter(const PredictionFormat output_format, const bool distances) : format{output_format}, write_distances{distances} {}
+
+    bool open(const std::string& filename) {
+
+        labels_file.open(filename, std::ios::binary | std::ios::trunc);
+
+        if (format == PredictionFormat::Binary && write_distances)
+        {
+            distances_file.open(filename + ".distances", std::ios::binary | std::ios::trunc);
+            return labels_file.is_open() && distances_file.is_open();
+        }
+
+        return labels_file.is_open();
+    }
+
+    bool write(const int* labels, const FType* distances, const std::size_t rows) {
+
+        if (format == PredictionFormat::Binary)
+        {
+            labels_file.write(reinterpret_cast<const char*>(labels), rows * sizeof(int));
+
+            if (write_distances)
+            {
+                distances_file.write(reinterpret_cast<const char*>(distances), rows * sizeof(FType));
+            }
+
+            return labels_file.good() && (!write_distances || distances_file.good());
+        }
+
+        // a label needs at most 11 characters and a shortest round trip FType at most 24
+        text.resize(rows * 40);
+        char* ptr = text.data();
+
+        for (std::size_t row = 0; row < rows; ++row)
+        {
+            ptr = std::to_chars(ptr, text.data() + text.size(), labels[row]).ptr;
+
+            if (write_distances)
+            {
+                *ptr++ = ',';
+                ptr = std::to_chars(ptr, text.data() + text.size(), distances[row]).ptr;
+            }
+
+            *ptr++ = '\n';
+        }
+
+        labels_file.write(text.data(), ptr - text.data());
+        return labels_file.good();
+    }
+
+};
+
+}
+
+template <std::floating_point FType>
+bool predictStream(const Parallel_KMeans<FType>& kmeans, 
+                   RowStream<FType>& input, 
+                   const std::string& output_filename, 
+                   const PredictionFormat format, 
+                   const bool write_distances,
+                   const std::size_t chunk_rows) {
+
+    if (input.cols() != kmeans.n_features || kmeans.centroids.empty())
+    {
+        std::cerr << "Error: The input has " << input.cols() << " columns but the model expects " << kmeans.n_features << std::endl;
+        return false;
+    }
+
+    PredictionWriter<FType> writer(format, write_distances);
+
+    if (!writer.open(output_filename))
+    {
+        std::cerr << "Error: Cannot write the predictions to " << output_filename << std::endl;
+        return false;
+    }
+
+    // two buffers of each kind: one is used by the reader or writer thread while the other one is predicted
+    const std::size_t stride = kmeans.row_stride;
+    std::vector<FType, AlignedAllocator<FType>> buffers[2] = {
+        std::vector<FType, AlignedAllocator<FType>>(chunk_rows * stride),
+        std::vector<FType, AlignedAllocator<FType>>(chunk_rows * stride)
+    };
+    std::vector<int> labels[2] = {std::vector<int>(chunk_rows), std::vector<int>(chunk_rows)};
+    std::vector<FType> distances[2] = {std::vector<FType>(write_distances ? chunk_rows : 0), std::vector<FType>(write_distances ? chunk_rows : 0)};
+
+    // one reader and one writer thread for the whole stream, every step hands them the buffers it does not use
+    BackgroundThread read_thread;
+    BackgroundThread write_thread;
+    std::size_t n_rows = input.readRows(buffers[0].data(), chunk_rows);
+    std::size_t next_rows = 0;
+    std::size_t total_rows = 0;
+    int current = 0;
+    bool success = true;
+
+    while (n_rows > 0 && success)
+    {
+        read_thread.submit([&input, &buffers, &next_rows, current, chunk_rows]() {
+            next_rows = input.readRows(buffers[1 - current].data(), chunk_rows);
+            return true;
+        });
+
+        kmeans.predict(buffers[current].data(), n_rows, labels[current].data(), write_distances ? distances[current].data() : nullptr);
+
+        // the previous chunk has to be written before its buffers are used again in the next step
+        success = write_thread.wait();
+
+        write_thread.submit([&writer, &labels, &distances, current, n_rows]() {
+            return writer.write(labels[current].data(), distances[current].data(), n_rows);
+        });
+
+        total_rows += n_rows;
+        read_thread.wait();
+        n_rows = next_rows;
+        current = 1 - current;
+    }
+
+    if (!write_thread.wait())
+    {
+        success = false;
+    }
+
+    if (!success)
+    {
+        std::cerr << "Error: Failed to write the predictions to " << output_filename << std::endl;
+    }
+
+    if (!input.good())
+    {
+        std::cerr << "Error: Failed to read the input after " << total_rows << " rows" << std::endl;
+        success = false;
+    }
+
+    std::cout << "Predicted " << total_rows << " rows" << std::endl;
+
+    return success;
+}
+
+template bool predictStream<float>(const Parallel_KMeans<float>& kmeans, RowStream<float>& input, const std::string& output_filename, const PredictionFormat format, const bool write_distances, const std::size_t chunk_rows);
+template bool predictStream<double>(const Parallel_KMeans<double>& kmeans, RowStream<double>& input, const std::string& output_filename, const PredictionFormat format, const bool write_distances, const std::size_t chunk_rows);
+
+#endif
@@ -2,16 +2,138 @@
 #include <Aligned_Allocator.h>
 #include <SIMD_Operations.h>
 #include <Tests.h>
+#include <CSR_Matrix.h>
+#include <Dataset.h>
+#include <Chunk_Source.h>
+#include <Thread_Pool.h>
 
 #include <iostream>
 #include <random>
 #include <concepts>
 #include <omp.h>
 #include <optional>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <sstream>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char MODEL_MAGIC[8] = {'K', 'M', 'M', 'O', 'D', 'E', 'L', '\0'};
+constexpr std::uint32_t MODEL_VERSION = 1;
+
+// the header is padded to this size, the centroid rows start right after it
+constexpr std::size_t MODEL_HEADER_BYTES = 128;
+
+// how the saved centroids were initialized and which distance they minimize
+constexpr std::uint32_t MODEL_INIT_RANDOM_ROWS = 0;
+constexpr std::uint32_t MODEL_INIT_WARM_START = 1;
+constexpr std::uint32_t MODEL_METRIC_EUCLIDEAN = 0;
+
+// fixed size header of a .kmmodel file, all values are stored in the byte order of the machine
+struct ModelHeader {
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t item_size;
+    std::uint64_t n_cluster;
+    std::uint64_t n_features;
+    std::uint64_t row_stride;
+    std::int64_t n_iter;
+    double inertia;
+    double tol;
+    std::int64_t max_iter;
+    std::int64_t seed;
+    std::uint32_t has_seed;
+    std::uint32_t init;
+    std::uint32_t metric;
+    std::uint32_t deterministic;
+
+    // only set in checkpoints: number of rows of the fitted data and the position of the RNG state
+    std::uint64_t rows;
+    std::uint64_t rng_offset;
+    std::uint64_t rng_bytes;
+
+};
+
+static_assert(sizeof(ModelHeader) <= MODEL_HEADER_BYTES);
+
+// header of a model file with the current state of the model, n_iter is the number of finished iterations
+template <typename Model>
+ModelHeader modelHeader(const Model& model, const int iterations) {
+
+    ModelHeader header{};
+    std::memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version = MODEL_VERSION;
+    header.item_size = sizeof(model.centroids[0]);
+    header.n_cluster = model.n_cluster;
+    header.n_features = model.n_features;
+    header.row_stride = model.row_stride;
+    header.n_iter = iterations;
+    header.inertia = model.inertia;
+    header.tol = model.tol;
+    header.max_iter = model.max_iter;
+    header.seed = model.seed.value_or(0);
+    header.has_seed = model.seed.has_value();
+    header.init = model.warm_start ? MODEL_INIT_WARM_START : MODEL_INIT_RANDOM_ROWS;
+    header.metric = MODEL_METRIC_EUCLIDEAN;
+    header.deterministic = model.deterministic;
+
+    return header;
+}
+
+// writes the header, the centroid rows and the RNG state (checkpoints only) to <filename>.tmp and renames it
+// so a reader never sees a partial file
+template <typename FType>
+bool writeModelFile(const std::string& filename, ModelHeader header, const FType* values, const std::size_t n_values, const std::string& rng_state) {
+
+    header.rng_offset = rng_state.empty() ? 0 : MODEL_HEADER_BYTES + n_values * sizeof(FType);
+    header.rng_bytes = rng_state.size();
+
+    const std::string temporary_filename = filename + ".tmp";
+    std::ofstream file(temporary_filename, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Cannot write the model " << filename << std::endl;
+        return false;
+    }
+
+    const std::vector<char> padding(MODEL_HEADER_BYTES - sizeof(header), 0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char*>(values), n_values * sizeof(FType));
+    file.write(rng_state.data(), rng_state.size());
+    file.close();
 
+    std::error_code error;
+    if (!file || (std::filesystem::rename(temporary_filename, filename, error), error))
+    {
+        std::cerr << "Error: Cannot write the model " << filename << std::endl;
+        std::filesystem::remove(temporary_filename, error);
+        return false;
+    }
+
+    return true;
+}
 
-template <std::floating_point FType, std::integral IType>
-Parallel_KMeans<FType, IType>::Parallel_KMeans(const int n_cluster, const int max_iter, const double tol, std::optional<int> seed)
+}
+
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+Parallel_KMeans<FType, IType, AType>::Parallel_KMeans(const int n_cluster, const int max_iter, const double tol, std::optional<int> seed)
     : n_cluster{n_cluster},
     max_iter{max_iter},
     tol{tol},
@@ -36,8 +158,48 @@ Parallel_KMeans<FType, IType>::Parallel_KMeans(const int n_cluster, const int ma
 
     }
 
-template <std::floating_point FType, std::integral IType>
-void Parallel_KMeans<FType, IType>::initializeCentroids(const std::vector<FType, AlignedAllocator<FType>>& data, const IType rows, const IType cols){
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+template <typename Body>
+void Parallel_KMeans<FType, IType, AType>::parallelFor(const IType n, const IType grain, Body body) const {
+
+    if (parallel_backend == ParallelBackend::ThreadPool)
+    {
+        ThreadPool::shared().parallelFor(n, grain, [&](const std::size_t first, const std::size_t last, const std::size_t slot) {
+            body(static_cast<IType>(first), static_cast<IType>(last), static_cast<int>(slot));
+        });
+
+        return;
+    }
+
+    // one contiguous range per thread like schedule(static), the grain only matters for stealing
+    #pragma omp parallel default(none) shared(n, body)
+    {
+        const std::size_t thread = omp_get_thread_num();
+        const std::size_t n_team = omp_get_num_threads();
+        const IType first = n * thread / n_team;
+        const IType last = n * (thread + 1) / n_team;
+
+        if (first < last)
+        {
+            body(first, last, static_cast<int>(thread));
+        }
+    }
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+IType Parallel_KMeans<FType, IType, AType>::parallelSlots() const {
+
+    if (parallel_backend == ParallelBackend::ThreadPool)
+    {
+        return ThreadPool::shared().slots();
+    }
+
+    return omp_get_max_threads();
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::initializeCentroids(const FType* data, const IType rows, const IType cols){
 
     // get the random initial centroids form the intial data
     std::uniform_int_distribution<> dist{0,  static_cast<int>(rows - 1)};
@@ -56,9 +218,9 @@ void Parallel_KMeans<FType, IType>::initializeCentroids(const std::vector<FType,
 
 }
 
-template <std::floating_point FType, std::integral IType>
-void Parallel_KMeans<FType, IType>::ReinitializeCentroids(
-    const std::vector<FType, AlignedAllocator<FType>>& data, 
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::ReinitializeCentroids(
+    const FType* data, 
     std::vector<FType, AlignedAllocator<FType>>& new_centroids, 
     int cluster_idx,
     const IType rows, 
@@ -76,8 +238,8 @@ void Parallel_KMeans<FType, IType>::ReinitializeCentroids(
     }
 }
 
-template <std::floating_point FType, std::integral IType>
-void Parallel_KMeans<FType, IType>::fit(const std::vector<std::vector<FType>>& data){
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::fit(const std::vector<std::vector<FType>>& data){
 
     // set the constant row and col size to determine later loop iterations
     const IType rows = data.size();
@@ -86,24 +248,35 @@ void Parallel_KMeans<FType, IType>::fit(const std::vector<std::vector<FType>>& d
     if (cols == 0)
     {
         std::cerr << "Data vector is empty" << std::endl;
+        return;
     }
 
-    //std::cout << "Rows:" << rows << std::endl;
-    //std::cout << "Cols:" << cols << std::endl;
-    
+    for (IType row = 0; row < rows; ++row)
+    {
+        if (data[row].size() != cols)
+        {
+            std::cerr << "Row " << row << " has " << data[row].size() << " values but the first row " << cols << std::endl;
+            return;
+        }
+    }
 
-    std::vector<FType, AlignedAllocator<FType>> new_data(rows * cols, 0);
+    // every row is padded with zeros so that it starts on a BYTE_ALIGNMENT boundary
+    const IType stride = alignedRowSize<FType>(cols);
+    std::vector<FType, AlignedAllocator<FType>> new_data(rows * stride, 0);
 
     // fill the new flat array with values
-    for (IType row = 0; row < rows; ++row)
-    {
-        FType* new_data_ptr = &new_data[row * cols];
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
 
-        for (IType col = 0; col < cols; ++col)
+        for (IType row = first; row < last; ++row)
         {
-            new_data_ptr[col] = data[row][col];
+            FType* new_data_ptr = &new_data[row * stride];
+
+            for (IType col = 0; col < cols; ++col)
+            {
+                new_data_ptr[col] = data[row][col];
+            }
         }
-    }
+    });
 
     if (is_memory_aligned(new_data))
     {
@@ -114,316 +287,284 @@ void Parallel_KMeans<FType, IType>::fit(const std::vector<std::vector<FType>>& d
         std::cout << "new_data is NOT memory aligned" << std::endl;
     }
 
-    //std::cout << "New_data expected size:" << rows * cols << std::endl;
-    //std::cout << "Actual size:" << new_data.size() << std::endl;
+    fitAligned(new_data.data(), rows, cols);
 
-    // initialize the new centroids and the centroid member variables with 0's
-    std::vector<FType, AlignedAllocator<FType>> new_centroids(n_cluster * cols, 0);
-    centroids = new_centroids;
+}
 
-    #ifdef DEBUG
-    std::cout << "Fit first call new_centroids" << std::endl;
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::fit(const FType* data, const IType rows, const IType cols, const IType stride){
 
-    for (IType i = 0; i < rows; ++i)
+    if (rows == 0 || cols == 0)
     {
-        
-        for (IType j = 0; j < cols; ++j)
-        {
-            std::cout << new_centroids[i * cols + col] << " ";
-        }
-
-        std::cout << std::endl;
+        std::cerr << "Data is empty" << std::endl;
+        finishRun();
+        return;
     }
-    #endif
 
-    // initiaize the labels of the points
-    std::vector<int> labels_new(rows, 0);
-    this->labels = std::move(labels_new);
+    const IType aligned_stride = alignedRowSize<FType>(cols);
 
-    initializeCentroids(new_data, rows, cols);
-    int iter = 1;
+    // the buffer is only used in place if its rows have no padding at all, the padding of a caller's strided rows
+    // (e.g. the columns after a NumPy column slice) holds other values and would be read as part of every row
+    if (stride == cols && cols == aligned_stride && reinterpret_cast<std::uintptr_t>(data) % BYTE_ALIGNMENT == 0)
+    {
+        fitAligned(data, rows, cols);
+        return;
+    }
 
-    for (; iter < this->max_iter + 1; ++iter){
+    // otherwise the rows are repacked once in parallel
+    std::vector<FType, AlignedAllocator<FType>> new_data(rows * aligned_stride);
 
-        assignCentroids(new_data, rows, cols);
-        updateCentroids(new_data, new_centroids, rows, cols);
-        bool converged = calculateChange(new_centroids, cols);
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
 
-        if (converged)
-        {
-            std::cout << "Centroid positions have not changed anymore after " << iter << " iterations " 
-            << "within a tolerance of " << this->tol << std::endl;
-            this->n_iter = iter;
-            break;
-            
-        }
-        else
+        for (IType row = first; row < last; ++row)
         {
-            this->centroids = new_centroids;
+            std::copy(data + row * stride, data + row * stride + cols, &new_data[row * aligned_stride]);
+            std::fill(&new_data[row * aligned_stride] + cols, &new_data[row * aligned_stride] + aligned_stride, 0);
         }
-        
-    }
+    });
 
-    if (iter == this->max_iter)
-    {
-        std::cout << "Maximum number of iterations has been reached" << std::endl;
-        std::cout << "Maximum number of iterations: " << this->max_iter << std::endl;
-        this->n_iter = iter;
-    }
- 
+    fitAligned(new_data.data(), rows, cols);
 
 }
 
-template <std::floating_point FType, std::integral IType>
-std::vector<int> Parallel_KMeans<FType, IType>::predict(const std::vector<std::vector<FType>>& new_data){
-
-    const IType ROWS = new_data.size();
-    const int COLS = new_data.empty() ? 0: new_data[0].size();
-    if (COLS == 0)
-    {
-        std::cerr << "Data vector is empty" << std::endl;
-        return {};
-    }
-
-    std::vector<int> new_labels(ROWS, 0);
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::fit(const Dataset<FType>& data){
 
-    # pragma omp parallel for default(none) shared(new_labels, new_data, COLS, ROWS, centroids, n_cluster)
-    for (IType point = 0; point < ROWS; ++point)
+    // the padding of a Dataset is zero so its padded rows are used in place
+    if (data.rows > 0 && data.cols > 0 && data.stride == alignedRowSize<FType>(data.cols) && reinterpret_cast<std::uintptr_t>(data.data()) % BYTE_ALIGNMENT == 0)
     {
-        FType min_distance = std::numeric_limits<FType>::max();
-        int best_centroid_idx = 0;
-        const FType* new_data_ptr = new_data[point].data();
-
-        for (int centroid = 0; centroid < n_cluster; ++centroid)
-        {
-            FType distance = 0;
-            const FType* centroids_ptr = &centroids[centroid * COLS];
-            
-
-            distance = process(new_data_ptr, centroids_ptr, COLS);
-
-            // for (IType col_idx = 0; col_idx < COLS; ++col_idx)
-            // {
-                
-
-            //     // FType diff = new_data[point][col_idx] - centroids_ptr[col_idx];
-            //     // distance += diff * diff;
-            // }
-
-            distance = std::sqrt(distance);
-
-            if (distance < min_distance)
-            {
-                min_distance = distance;
-                best_centroid_idx = centroid;
-            }
-        }
-
-        new_labels[point] = best_centroid_idx;
+        fitAligned(data.data(), data.rows, data.cols);
+        return;
     }
 
-    return new_labels;
+    fit(data.data(), data.rows, data.cols, data.stride);
 
 }
 
-template <std::floating_point FType, std::integral IType>
-void Parallel_KMeans<FType, IType>::assignCentroids(
-    const std::vector<FType, AlignedAllocator<FType>>& data, 
-    IType rows, 
-    IType cols
-) {
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::fit(const ChunkSource<FType>& source){
 
-    double inertia_shared = 0; 
+    const IType rows = source.rows();
+    const IType n_cols = source.cols();
 
-    // find the new centroid for every data point
-    #pragma omp parallel for default(none) shared(data, rows, cols, n_cluster, labels, centroids) reduction( +: inertia_shared) schedule(static)
-    for (IType point = 0; point < rows; ++point)
+    if (rows == 0 || n_cols == 0)
     {
-        
-        // resets for each data point to find it's min distance
-        FType min_distance = std::numeric_limits<FType>::max();
-        int best_centroid_idx = 0;
-        // Each Thread gets a ptr to the point it is currently processing
-        const FType* data_ptr = &data[point * cols];
-
-        for (IType centroid_idx = 0; centroid_idx < n_cluster; ++centroid_idx){
-
-                FType distance = 0;
-                // each thread gets a ptr to the current centroid it is processing 
-                const FType* centroid_ptr = &centroids[centroid_idx * cols];
+        std::cerr << "Data is empty" << std::endl;
+        return;
+    }
 
-                #if defined(SIMD_256) || defined(SIMD_512)
-                distance = process(data_ptr, centroid_ptr, cols);
-                #endif
+    const bool warm = warmStart(rows, n_cols);
 
-            #ifdef NO_SIMD
-            #pragma omp simd
-            for (IType coord_idx = 0; coord_idx < cols; ++coord_idx)
-            {
+    this->n_features = n_cols;
+    this->row_stride = alignedRowSize<FType>(n_cols);
+    const IType cols = row_stride;
 
-                 FType single_distance = data_ptr[coord_idx] - centroid_ptr[coord_idx];
-                 distance += single_distance * single_distance;
+    const IType chunk_rows = std::clamp<IType>(stream_chunk_bytes / (cols * sizeof(FType)), 1, rows);
+    const IType n_chunks = (rows + chunk_rows - 1) / chunk_rows;
 
-            }
-            #endif
+    std::cout << "Streaming " << rows << " rows in " << n_chunks << " chunks of " << chunk_rows << " rows" << std::endl;
 
-            // calcuate the sqrt of the distance later once min distance is found so save some computation time
-            // fiding the min distance does not change 
-            // distance = std::sqrt(distance);
+    // double buffering: the next chunk is read into one buffer while the other one is processed
+    std::vector<FType, AlignedAllocator<FType>> chunk_buffers[2] = {
+        std::vector<FType, AlignedAllocator<FType>>(chunk_rows * cols),
+        std::vector<FType, AlignedAllocator<FType>>(chunk_rows * cols)
+    };
 
-            if (distance < min_distance){
-                min_distance = distance;
-                best_centroid_idx = centroid_idx;
-            }
+    auto read_chunk = [&source, rows, chunk_rows](const IType chunk, FType* buffer) {
+        const IType first_row = chunk * chunk_rows;
+        return source.readRows(first_row, std::min(chunk_rows, rows - first_row), buffer);
+    };
 
-        }
+    std::vector<FType, AlignedAllocator<FType>> new_centroids(n_cluster * cols, 0);
 
-        labels[point] = best_centroid_idx;
-        inertia_shared += std::sqrt(min_distance);
+    if (!warm)
+    {
+        centroids = new_centroids;
     }
 
-    this->inertia = inertia_shared;
-
+    // the initial centroids are sampled like in initializeCentroids, every sampled row is read on its own
+    std::uniform_int_distribution<std::uint64_t> dist{0, rows - 1};
 
-    #ifdef DEBUG
-    std::cout << "Assign Centroids Labels " << std::endl;
+    for (int cluster_idx = 0; cluster_idx < n_cluster && !warm; ++cluster_idx)
+    {
+        if (!source.readRows(dist(gen), 1, &centroids[cluster_idx * cols]))
+        {
+            std::cerr << "Failed to read the initial centroids" << std::endl;
+            return;
+        }
+    }
 
-    for (IType i = 0; i < labels.size(); ++i)
+    if (!read_chunk(0, chunk_buffers[0].data()))
     {
-        std::cout << labels[i] << " ";
+        std::cerr << "Failed to read the first chunk" << std::endl;
+        return;
     }
 
-    std::cout << std::endl;
-    #endif
+    // only the sums over all chunks, the labels of all rows (optional) and the two chunks stay resident
+    std::vector<AType> stream_sums(n_cluster * cols);
+    std::vector<std::size_t> stream_counts(n_cluster);
+    std::vector<int> stream_labels_all(stream_labels ? rows : 0);
+    int current = 0;
 
-}
+    // one reader thread for the whole fit, every chunk hands it the buffer that is not processed
+    BackgroundThread reader;
 
+    // a resumed fit continues with the iteration after the checkpoint
+    int iter = resume_iter + 1;
+    resume_iter = 0;
+    this->cancelled = false;
+    startRun();
+    startCheckpoints();
 
-template <std::floating_point FType, std::integral IType>
-void Parallel_KMeans<FType, IType>::updateCentroids(
-    const std::vector<FType, AlignedAllocator<FType>>& data, 
-    std::vector<FType, AlignedAllocator<FType>>& new_centroids,
-    const IType rows, 
-    const IType cols)
-    {
+    for (; iter < this->max_iter + 1 && !stopRequested(iter); ++iter){
 
+        std::fill(stream_sums.begin(), stream_sums.end(), 0);
+        std::fill(stream_counts.begin(), stream_counts.end(), 0);
+        double stream_inertia = 0;
 
-    // reset the centroids before each update
-    std::fill(new_centroids.begin(), new_centroids.end(), 0.0);
+        for (IType chunk = 0; chunk < n_chunks; ++chunk)
+        {
+            const IType first_row = chunk * chunk_rows;
+            const IType n_rows = std::min(chunk_rows, rows - first_row);
+            const FType* chunk_data = chunk_buffers[current].data();
 
-    std::vector<int> counts(n_cluster, 0);
-    const int n_clusters = n_cluster;
+            // after the last chunk the first one is read again for the next iteration
+            if (n_chunks > 1)
+            {
+                reader.submit([&read_chunk, &chunk_buffers, chunk, n_chunks, current]() {
+                    return read_chunk((chunk + 1) % n_chunks, chunk_buffers[1 - current].data());
+                });
+            }
 
-    #pragma omp parallel default(none) shared(counts, data, rows, cols, n_clusters, new_centroids, labels)
-    {
+            // the chunk is processed like a data set of its own, labels holds the labels of the chunk
+            labels.resize(n_rows);
+            assignCentroids(chunk_data, n_rows, cols);
+            stream_inertia += inertia;
 
-    std::vector<int> counts_private (n_clusters, 0);
-    std::vector<FType> new_centroids_partial(n_clusters * cols);
+            reduceCentroidSums(n_rows, cols, [&](const IType point, AType* new_centroids_partial_ptr) {
 
-    #pragma omp for nowait
-    for (IType point = 0; point < rows; ++point)
-    {
+                const FType* data_ptr = &chunk_data[point * cols];
 
-            int cluster = labels[point];
-            counts_private[cluster] += 1;
-            FType* new_centroids_partial_ptr = &new_centroids_partial[cluster * cols];
-            const FType* data_ptr = &data[point * cols];
-            
-            for (IType col_idx = 0; col_idx < cols; ++col_idx)
+                #pragma omp simd
+                for (IType col_idx = 0; col_idx < cols; ++col_idx)
+                {
+                    new_centroids_partial_ptr[col_idx] += data_ptr[col_idx];
+                }
+            });
+
+            // chunks are added in a fixed order so the deterministic mode stays thread count independent
+            #pragma omp simd
+            for (IType element = 0; element < stream_sums.size(); ++element)
             {
-                
-                new_centroids_partial_ptr[col_idx] += data_ptr[col_idx];
+                stream_sums[element] += centroid_sums[element];
+            }
 
+            for (int cluster_idx = 0; cluster_idx < n_cluster; ++cluster_idx)
+            {
+                stream_counts[cluster_idx] += cluster_counts[cluster_idx];
             }
-            
-    }
 
-    #pragma omp critical
-    {
-        for (int centroid = 0; centroid < n_clusters; ++centroid)
-        {
-            counts[centroid] += counts_private[centroid];
-            FType* new_centroids_ptr = &new_centroids[centroid * cols];
-            FType* new_centroids_partial_ptr = &new_centroids_partial[centroid * cols];
+            if (stream_labels)
+            {
+                std::copy(labels.begin(), labels.end(), stream_labels_all.begin() + first_row);
+            }
 
-            for (IType col_idx = 0; col_idx < cols; ++col_idx)
+            if (n_chunks > 1)
             {
-                new_centroids_ptr[col_idx] += new_centroids_partial_ptr[col_idx];
+                if (!reader.wait())
+                {
+                    std::cerr << "Failed to read chunk " << (chunk + 1) % n_chunks << std::endl;
+                    finishRun();
+                    return;
+                }
+
+                current = 1 - current;
             }
         }
-    }
 
+        this->inertia = stream_inertia;
 
+        for (int cluster_idx = 0; cluster_idx < n_cluster; ++cluster_idx)
+        {
+            FType* new_centroids_ptr = &new_centroids[cluster_idx * cols];
+            const AType* stream_sums_ptr = &stream_sums[cluster_idx * cols];
 
+            if (stream_counts[cluster_idx] > 0)
+            {
+                const AType count = stream_counts[cluster_idx];
 
-    }
-
-
-    for (int cluster_idx = 0; cluster_idx < this->n_cluster; ++cluster_idx){
-
-        FType* new_centroids_ptr = &new_centroids[cluster_idx * cols];
+                #pragma omp simd
+                for (IType col_idx = 0; col_idx < cols; ++col_idx)
+                {
+                    new_centroids_ptr[col_idx] = static_cast<FType>(stream_sums_ptr[col_idx] / count);
+                }
+            }
 
-        if (counts[cluster_idx] > 0)
-        {
-            for (IType col_idx = 0; col_idx < cols; ++col_idx)
+            else
             {
-                new_centroids_ptr[col_idx] /= counts[cluster_idx];
+                // empty clusters are reinitialized from a random row of the whole source, read on its own like the
+                // initial centroids (no chunk is being read at this point)
+                if (!source.readRows(dist(gen), 1, new_centroids_ptr))
+                {
+                    std::cerr << "Failed to read a row to reinitialize cluster " << cluster_idx << std::endl;
+                    finishRun();
+                    return;
+                }
             }
         }
 
+        bool converged = calculateChange(new_centroids, cols);
+
+        if (converged)
+        {
+            std::cout << "Centroid positions have not changed anymore after " << iter << " iterations " 
+            << "within a tolerance of " << this->tol << std::endl;
+            this->n_iter = iter;
+            break;
+        }
         else
         {
-            ReinitializeCentroids(data, new_centroids, cluster_idx, rows, cols);
+            this->centroids = new_centroids;
+            checkpoint(iter, rows);
         }
-
     }
-    
-    #ifdef DEBUG
-    std::cout << "Counts vector" << std::endl;
 
-    for (int i = 0; i < counts.size(); ++i)
+    if (iter > this->max_iter && !cancelled)
     {
-        std::cout << counts[i] << " ";
+        std::cout << "Maximum number of iterations has been reached" << std::endl;
+        std::cout << "Maximum number of iterations: " << this->max_iter << std::endl;
+        this->n_iter = this->max_iter;
     }
 
-    std::cout << std::endl;
-
-    std::cout << "Update Centroids new centroids end" << std::endl;
-
-    for (IType i = 0; i < new_centroids.size(); ++i)
-    {
-        
-        for (IType j = 0; j < new_centroids[0].size(); ++j)
-        {
-            std::cout << new_centroids[i * cols + j] << " ";
-        }
-
-        std::cout << std::endl;
-    }
-    #endif
+    finishCheckpoints();
+    updateCentroidNorms();
+    finishRun();
 
+    this->labels = std::move(stream_labels_all);
 
 }
 
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::fitAligned(const FType* data, const IType rows, const IType n_cols){
 
-template <std::floating_point FType, std::integral IType>
-bool Parallel_KMeans<FType, IType>::calculateChange(std::vector<FType, AlignedAllocator<FType>>& new_centroids, const IType cols){
+    const bool warm = warmStart(rows, n_cols);
 
-    #ifdef DEBUG
-    std::cout << "Calculate change this centroids " << std::endl;
+    // from here on cols is the padded row length, the padding is zero in the data and the centroids
+    // so it changes neither the distances nor the means
+    this->n_features = n_cols;
+    this->row_stride = alignedRowSize<FType>(n_cols);
+    const IType cols = row_stride;
 
-    for (IType i = 0; i < rows; ++i)
-    {
-        
-        for (IType j = 0; j < cols; ++j)
-        {
-            std::cout << this->centroids[i * cols + j] << " ";
-        }
+    // initialize the new centroids and the centroid member variables with 0's
+    std::vector<FType, AlignedAllocator<FType>> new_centroids(n_cluster * cols, 0);
 
-        std::cout << std::endl;
+    if (!warm)
+    {
+        centroids = new_centroids;
     }
 
-     std::cout << "Calculate change new centroids " << std::endl;
+    #ifdef DEBUG
+    std::cout << "Fit first call new_centroids" << std::endl;
 
     for (IType i = 0; i < rows; ++i)
     {
@@ -437,32 +578,1401 @@ bool Parallel_KMeans<FType, IType>::calculateChange(std::vector<FType, AlignedAl
     }
     #endif
 
-    double epsilon = this->tol;
-    bool converged = true;
+    // initiaize the labels of the points
+    this->labels.assign(rows, 0);
 
-    for (int centroid_idx = 0; centroid_idx < this->n_cluster; ++centroid_idx)
+    if (!warm)
     {
-        double centroids_difference = 0;
-        FType* centroids_ptr = &centroids[centroid_idx * cols];
-        FType* new_centroids_ptr = &new_centroids[centroid_idx * cols];
+        initializeCentroids(data, rows, cols);
+    }
 
-        for (IType col_idx = 0; col_idx < cols; ++col_idx)
-        {
-            double centroids_diff = centroids_ptr[col_idx] - new_centroids_ptr[col_idx];
-            centroids_difference += centroids_diff * centroids_diff;
+    // a resumed fit continues with the iteration after the checkpoint
+    int iter = resume_iter + 1;
+    resume_iter = 0;
+    this->cancelled = false;
+    startRun();
+    startCheckpoints();
 
-        }
+    for (; iter < this->max_iter + 1 && !stopRequested(iter); ++iter){
 
-        centroids_difference = std::sqrt(centroids_difference);
+        assignCentroids(data, rows, cols);
+        updateCentroids(data, new_centroids, rows, cols);
+        bool converged = calculateChange(new_centroids, cols);
 
-        if (centroids_difference >= epsilon)
+        if (converged)
         {
-
-            converged = false;
+            std::cout << "Centroid positions have not changed anymore after " << iter << " iterations " 
+            << "within a tolerance of " << this->tol << std::endl;
+            this->n_iter = iter;
             break;
-        
+            
         }
-
+        else
+        {
+            this->centroids = new_centroids;
+            checkpoint(iter, rows);
+        }
+        
+    }
+
+    if (iter > this->max_iter && !cancelled)
+    {
+        std::cout << "Maximum number of iterations has been reached" << std::endl;
+        std::cout << "Maximum number of iterations: " << this->max_iter << std::endl;
+        this->n_iter = this->max_iter;
+    }
+
+    finishCheckpoints();
+    updateCentroidNorms();
+    finishRun();
+ 
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+std::vector<int> Parallel_KMeans<FType, IType, AType>::predict(const std::vector<std::vector<FType>>& new_data){
+
+    const IType ROWS = new_data.size();
+    const IType COLS = new_data.empty() ? 0: new_data[0].size();
+    if (COLS == 0 || COLS != n_features)
+    {
+        std::cerr << "Data vector is empty or does not match the fitted centroids" << std::endl;
+        return {};
+    }
+
+    // every row is copied into a row_stride buffer so a ragged input has to be rejected before
+    for (IType point = 0; point < ROWS; ++point)
+    {
+        if (new_data[point].size() != COLS)
+        {
+            std::cerr << "Row " << point << " has " << new_data[point].size() << " values but the centroids " << COLS << std::endl;
+            return {};
+        }
+    }
+
+    // the SIMD kernels use aligned loads so every row is copied into a padded row buffer first
+    const IType STRIDE = row_stride;
+    std::vector<int> new_labels(ROWS, 0);
+
+    parallelFor(ROWS, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+        std::vector<FType, AlignedAllocator<FType>> row_buffer(STRIDE, 0);
+
+        for (IType point = first; point < last; ++point)
+        {
+            std::copy(new_data[point].begin(), new_data[point].end(), row_buffer.begin());
+
+            FType min_distance;
+            new_labels[point] = nearestCentroid(row_buffer.data(), STRIDE, min_distance);
+        }
+    });
+
+    return new_labels;
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::predict(const FType* data, const IType rows, int* new_labels, FType* distances) const {
+
+    if (rows < small_batch_rows && small_batch_norms.size() == static_cast<std::size_t>(n_cluster))
+    {
+        predictSmallBatch(data, rows, n_features, row_stride, new_labels, distances);
+        return;
+    }
+
+    const IType cols = row_stride;
+
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+        for (IType point = first; point < last; ++point)
+        {
+            FType min_distance;
+            new_labels[point] = nearestCentroid(&data[point * cols], cols, min_distance);
+
+            if (distances != nullptr)
+            {
+                distances[point] = std::sqrt(min_distance);
+            }
+        }
+    });
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::predict(const FType* data, const IType rows, const IType cols, const IType stride, int* new_labels, FType* distances) const {
+
+    if (cols == 0 || cols != n_features || stride < cols)
+    {
+        std::cerr << "Data does not match the fitted centroids" << std::endl;
+        return false;
+    }
+
+    // the small batch path reads the rows in place whatever their layout
+    if (rows < small_batch_rows && small_batch_norms.size() == static_cast<std::size_t>(n_cluster))
+    {
+        predictSmallBatch(data, rows, cols, stride, new_labels, distances);
+        return true;
+    }
+
+    // in place only for rows without padding, see fit
+    if (stride == cols && cols == row_stride && reinterpret_cast<std::uintptr_t>(data) % BYTE_ALIGNMENT == 0)
+    {
+        predict(data, rows, new_labels, distances);
+        return true;
+    }
+
+    const IType padded_cols = row_stride;
+
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+        std::vector<FType, AlignedAllocator<FType>> row_buffer(padded_cols, 0);
+
+        for (IType point = first; point < last; ++point)
+        {
+            std::copy(data + point * stride, data + point * stride + cols, row_buffer.begin());
+
+            FType min_distance;
+            new_labels[point] = nearestCentroid(row_buffer.data(), padded_cols, min_distance);
+
+            if (distances != nullptr)
+            {
+                distances[point] = std::sqrt(min_distance);
+            }
+        }
+    });
+
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::predictSmallBatch(const FType* data, const IType rows, const IType cols, const IType stride, int* new_labels, FType* distances) const {
+
+    const FType* norms = small_batch_norms.data();
+
+    for (IType point = 0; point < rows; ++point)
+    {
+        const FType* data_ptr = data + point * stride;
+        FType min_distance = std::numeric_limits<FType>::max();
+        int best_centroid_idx = 0;
+
+        // |x - c|^2 = |x|^2 - 2 x.c + |c|^2 where |x|^2 is the same for all centroids
+        for (int centroid_idx = 0; centroid_idx < n_cluster; ++centroid_idx)
+        {
+            const FType* centroid_ptr = &centroids[centroid_idx * row_stride];
+            FType dot = 0;
+
+            #pragma omp simd reduction(+: dot)
+            for (IType col = 0; col < cols; ++col)
+            {
+                dot += data_ptr[col] * centroid_ptr[col];
+            }
+
+            const FType distance = norms[centroid_idx] - 2 * dot;
+
+            if (distance < min_distance)
+            {
+                min_distance = distance;
+                best_centroid_idx = centroid_idx;
+            }
+        }
+
+        new_labels[point] = best_centroid_idx;
+
+        if (distances != nullptr)
+        {
+            FType norm = 0;
+
+            #pragma omp simd reduction(+: norm)
+            for (IType col = 0; col < cols; ++col)
+            {
+                norm += data_ptr[col] * data_ptr[col];
+            }
+
+            // the expansion can become slightly negative through cancellation for points on a centroid
+            distances[point] = std::sqrt(std::max(norm + min_distance, FType(0)));
+        }
+    }
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::updateCentroidNorms() {
+
+    small_batch_norms = calculateCentroidNorms(row_stride);
+
+    // the centroids were replaced, the next partialFit takes its weights from the labels of the fit
+    cluster_weights.clear();
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::predictTopK(const FType* data, const IType rows, const IType cols, const IType stride, const int m, int* indices, FType* distances) const {
+
+    if (cols == 0 || cols != n_features || stride < cols)
+    {
+        std::cerr << "Data does not match the fitted centroids" << std::endl;
+        return false;
+    }
+
+    if (m < 1 || m > n_cluster)
+    {
+        std::cerr << "The number of nearest centroids must be between 1 and " << n_cluster << std::endl;
+        return false;
+    }
+
+    const IType padded_cols = row_stride;
+    // in place only for rows without padding, the padding of strided rows is not zero (see fit)
+    const bool padded = stride == cols && cols == row_stride && reinterpret_cast<std::uintptr_t>(data) % BYTE_ALIGNMENT == 0;
+    const int n_clusters = n_cluster;
+
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+        // the candidates of the current row sorted by distance, reused for every row of the range
+        std::vector<FType> best_distances(m);
+        std::vector<int> best_indices(m);
+        std::vector<FType, AlignedAllocator<FType>> row_buffer(padded ? 0 : padded_cols, 0);
+
+        for (IType point = first; point < last; ++point)
+        {
+            const FType* data_ptr = data + point * stride;
+
+            if (!padded)
+            {
+                std::copy(data_ptr, data_ptr + cols, row_buffer.begin());
+                data_ptr = row_buffer.data();
+            }
+
+            int n_best = 0;
+
+            for (int centroid_idx = 0; centroid_idx < n_clusters; ++centroid_idx)
+            {
+                const FType distance = squaredDistance(data_ptr, &centroids[centroid_idx * padded_cols], padded_cols);
+
+                // most centroids are farther than the m-th best and are rejected by this single comparison
+                if (n_best == m && distance >= best_distances[m - 1])
+                {
+                    continue;
+                }
+
+                // insertion into the sorted candidates, equal distances keep the lower centroid index first like predict
+                int position = n_best < m ? n_best++ : m - 1;
+
+                for (; position > 0 && best_distances[position - 1] > distance; --position)
+                {
+                    best_distances[position] = best_distances[position - 1];
+                    best_indices[position] = best_indices[position - 1];
+                }
+
+                best_distances[position] = distance;
+                best_indices[position] = centroid_idx;
+            }
+
+            for (int candidate = 0; candidate < m; ++candidate)
+            {
+                indices[point * m + candidate] = best_indices[candidate];
+
+                if (distances != nullptr)
+                {
+                    distances[point * m + candidate] = std::sqrt(best_distances[candidate]);
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::transform(const FType* data, const IType rows, const IType cols, const IType stride, FType* distances, const IType distance_stride, const bool squared) const {
+
+    if (cols == 0 || cols != n_features || stride < cols || distance_stride < static_cast<IType>(n_cluster))
+    {
+        std::cerr << "Data does not match the fitted centroids" << std::endl;
+        return false;
+    }
+
+    // same tiling as assignCentroidsTiled, a tile of centroids stays in the cache while a tile of rows is compared against it
+    const IType centroid_cols = row_stride;
+    const int centroid_tile = std::max<IType>(1, centroid_tile_bytes / (centroid_cols * sizeof(FType)));
+    const IType n_point_tiles = (rows + ASSIGN_POINT_TILE - 1) / ASSIGN_POINT_TILE;
+    const int n_clusters = n_cluster;
+    const std::vector<FType> centroid_norms = calculateCentroidNorms(centroid_cols);
+
+    parallelFor(n_point_tiles, 1, [&](const IType first_tile, const IType last_tile, const int) {
+
+        std::vector<FType> row_norms(ASSIGN_POINT_TILE);
+
+        // the expansion can become slightly negative through cancellation for points on a centroid
+        auto store = [&](const IType point, const int centroid_idx, const FType dot) {
+            const FType distance = std::max(row_norms[point % ASSIGN_POINT_TILE] - 2 * dot + centroid_norms[centroid_idx], FType(0));
+            distances[point * distance_stride + centroid_idx] = squared ? distance : std::sqrt(distance);
+        };
+
+        for (IType tile = first_tile; tile < last_tile; ++tile)
+        {
+            const IType first_point = tile * ASSIGN_POINT_TILE;
+            const IType last_point = std::min(rows, first_point + ASSIGN_POINT_TILE);
+
+            for (IType point = first_point; point < last_point; ++point)
+            {
+                const FType* data_ptr = data + point * stride;
+                FType norm = 0;
+
+                #pragma omp simd reduction(+: norm)
+                for (IType col = 0; col < cols; ++col)
+                {
+                    norm += data_ptr[col] * data_ptr[col];
+                }
+
+                row_norms[point % ASSIGN_POINT_TILE] = norm;
+            }
+
+            for (int first_centroid = 0; first_centroid < n_clusters; first_centroid += centroid_tile)
+            {
+                const int last_centroid = std::min(n_clusters, first_centroid + centroid_tile);
+                IType point = first_point;
+
+                // TRANSFORM_ROW_BLOCK rows against one centroid at a time, every centroid value is loaded once for all of them
+                static_assert(TRANSFORM_ROW_BLOCK == 4, "the transform kernel below is unrolled for exactly 4 rows");
+                for (; point + TRANSFORM_ROW_BLOCK <= last_point; point += TRANSFORM_ROW_BLOCK)
+                {
+                    const FType* row_0 = data + point * stride;
+                    const FType* row_1 = row_0 + stride;
+                    const FType* row_2 = row_1 + stride;
+                    const FType* row_3 = row_2 + stride;
+
+                    for (int centroid_idx = first_centroid; centroid_idx < last_centroid; ++centroid_idx)
+                    {
+                        const FType* centroid_ptr = &centroids[centroid_idx * centroid_cols];
+                        FType dot_0 = 0, dot_1 = 0, dot_2 = 0, dot_3 = 0;
+
+                        #pragma omp simd reduction(+: dot_0, dot_1, dot_2, dot_3)
+                        for (IType col = 0; col < cols; ++col)
+                        {
+                            dot_0 += row_0[col] * centroid_ptr[col];
+                            dot_1 += row_1[col] * centroid_ptr[col];
+                            dot_2 += row_2[col] * centroid_ptr[col];
+                            dot_3 += row_3[col] * centroid_ptr[col];
+                        }
+
+                        store(point, centroid_idx, dot_0);
+                        store(point + 1, centroid_idx, dot_1);
+                        store(point + 2, centroid_idx, dot_2);
+                        store(point + 3, centroid_idx, dot_3);
+                    }
+                }
+
+                for (; point < last_point; ++point)
+                {
+                    const FType* data_ptr = data + point * stride;
+
+                    for (int centroid_idx = first_centroid; centroid_idx < last_centroid; ++centroid_idx)
+                    {
+                        const FType* centroid_ptr = &centroids[centroid_idx * centroid_cols];
+                        FType dot = 0;
+
+                        #pragma omp simd reduction(+: dot)
+                        for (IType col = 0; col < cols; ++col)
+                        {
+                            dot += data_ptr[col] * centroid_ptr[col];
+                        }
+
+                        store(point, centroid_idx, dot);
+                    }
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::partialFit(const FType* data, const IType rows, const IType cols, const IType stride){
+
+    if (rows == 0 || cols == 0 || stride < cols || (n_features != 0 && cols != n_features))
+    {
+        std::cerr << "Batch is empty or does not match the centroids" << std::endl;
+        return false;
+    }
+
+    if (n_features == 0 || centroids.size() < static_cast<std::size_t>(n_cluster) * row_stride)
+    {
+        if (rows < static_cast<IType>(n_cluster))
+        {
+            std::cerr << "The first batch needs at least " << n_cluster << " rows" << std::endl;
+            return false;
+        }
+
+        this->n_features = cols;
+        this->row_stride = alignedRowSize<FType>(cols);
+        this->centroids.assign(n_cluster * row_stride, 0);
+
+        std::uniform_int_distribution<> dist{0, static_cast<int>(rows - 1)};
+
+        for (int cluster_idx = 0; cluster_idx < n_cluster; ++cluster_idx)
+        {
+            const FType* data_ptr = data + dist(gen) * stride;
+            std::copy(data_ptr, data_ptr + cols, &centroids[cluster_idx * row_stride]);
+        }
+
+        // a weight of 0 lets the batch replace the random rows by the mean of the rows they get
+        small_batch_norms = calculateCentroidNorms(row_stride);
+        cluster_weights.assign(n_cluster, 0);
+        this->n_iter = 0;
+    }
+
+    if (cluster_weights.size() != static_cast<std::size_t>(n_cluster))
+    {
+        // centroids without labels (from load, setCentroids or an out of core fit without stream_labels) count like
+        // an even share of the batch, with a weight of 0 they would be reseeded as empty clusters right away
+        const AType prior_weight = std::max<AType>(1, static_cast<AType>(rows) / n_cluster);
+        cluster_weights.assign(n_cluster, labels.empty() ? prior_weight : 0);
+
+        for (const int label : labels)
+        {
+            cluster_weights[label] += 1;
+        }
+
+        this->n_iter = 0;
+    }
+
+    // labels and point_distances only ever hold the current batch
+    labels.resize(rows);
+    point_distances.resize(rows);
+    predict(data, rows, cols, stride, labels.data(), point_distances.data());
+
+    const IType centroid_cols = row_stride;
+
+    reduceCentroidSums(rows, centroid_cols, [&](const IType point, AType* sums_ptr) {
+
+        const FType* data_ptr = data + point * stride;
+
+        #pragma omp simd
+        for (IType col_idx = 0; col_idx < cols; ++col_idx)
+        {
+            sums_ptr[col_idx] += data_ptr[col_idx];
+        }
+    });
+
+    // c = (decay * w * c + sum of the new rows) / (decay * w + new rows), the padding stays 0
+    for (int cluster_idx = 0; cluster_idx < n_cluster; ++cluster_idx)
+    {
+        const AType past_weight = partial_fit_decay * cluster_weights[cluster_idx];
+        const AType weight = past_weight + cluster_counts[cluster_idx];
+        cluster_weights[cluster_idx] = weight;
+
+        if (cluster_counts[cluster_idx] == 0)
+        {
+            continue;
+        }
+
+        FType* centroid_ptr = &centroids[cluster_idx * centroid_cols];
+        const AType* sums_ptr = &centroid_sums[cluster_idx * centroid_cols];
+
+        #pragma omp simd
+        for (IType col_idx = 0; col_idx < cols; ++col_idx)
+        {
+            centroid_ptr[col_idx] = static_cast<FType>((past_weight * centroid_ptr[col_idx] + sums_ptr[col_idx]) / weight);
+        }
+    }
+
+    double batch_inertia = 0;
+
+    for (IType point = 0; point < rows; ++point)
+    {
+        batch_inertia += point_distances[point];
+    }
+
+    this->inertia = batch_inertia;
+
+    reseedClusters(data, rows, stride);
+
+    small_batch_norms = calculateCentroidNorms(row_stride);
+    this->n_iter += 1;
+
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::reseedClusters(const FType* data, const IType rows, const IType stride){
+
+    const AType max_weight = *std::max_element(cluster_weights.begin(), cluster_weights.end());
+    const AType threshold = reassignment_ratio * max_weight;
+
+    std::vector<int> dying;
+    AType min_weight = std::numeric_limits<AType>::max();
+
+    for (int cluster_idx = 0; cluster_idx < n_cluster; ++cluster_idx)
+    {
+        if (cluster_weights[cluster_idx] < threshold)
+        {
+            dying.push_back(cluster_idx);
+        }
+        else
+        {
+            min_weight = std::min(min_weight, cluster_weights[cluster_idx]);
+        }
+    }
+
+    if (dying.empty())
+    {
+        return;
+    }
+
+    // a reseeded cluster starts with the weight of the lightest live cluster so it is not reseeded right away again
+    if (min_weight == std::numeric_limits<AType>::max())
+    {
+        min_weight = 1;
+    }
+
+    // rows far from their centroid are where the current data is covered worst, so they are the most likely picks
+    std::vector<double> row_weights(rows);
+
+    for (IType point = 0; point < rows; ++point)
+    {
+        row_weights[point] = static_cast<double>(point_distances[point]) * point_distances[point];
+    }
+
+    for (const int cluster_idx : dying)
+    {
+        IType point;
+
+        if (std::all_of(row_weights.begin(), row_weights.end(), [](const double weight) { return weight == 0; }))
+        {
+            point = std::uniform_int_distribution<IType>{0, rows - 1}(gen);
+        }
+        else
+        {
+            point = std::discrete_distribution<IType>{row_weights.begin(), row_weights.end()}(gen);
+        }
+
+        // the row now is a centroid, it is not picked for another cluster of the same batch
+        row_weights[point] = 0;
+
+        FType* centroid_ptr = &centroids[cluster_idx * row_stride];
+        std::copy(data + point * stride, data + point * stride + n_features, centroid_ptr);
+        cluster_weights[cluster_idx] = min_weight;
+    }
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::setCentroids(const FType* new_centroids, const IType rows, const IType cols, const IType stride){
+
+    if (rows != static_cast<IType>(n_cluster) || cols == 0 || stride < cols)
+    {
+        std::cerr << "Expected " << n_cluster << " centroids but got " << rows << std::endl;
+        return false;
+    }
+
+    this->n_features = cols;
+    this->row_stride = alignedRowSize<FType>(cols);
+    this->centroids.assign(n_cluster * row_stride, 0);
+
+    for (int cluster_idx = 0; cluster_idx < n_cluster; ++cluster_idx)
+    {
+        std::copy(new_centroids + cluster_idx * stride, new_centroids + cluster_idx * stride + cols, &centroids[cluster_idx * row_stride]);
+    }
+
+    updateCentroidNorms();
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::save(const std::string& filename) const {
+
+    if (centroids.empty())
+    {
+        std::cerr << "Error: Cannot save a model without centroids" << std::endl;
+        return false;
+    }
+
+    if (!writeModelFile(filename, modelHeader(*this, n_iter), centroids.data(), centroids.size(), ""))
+    {
+        return false;
+    }
+
+    std::cout << "Saved model " << filename << std::endl;
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+std::unique_ptr<Parallel_KMeans<FType, IType, AType>> Parallel_KMeans<FType, IType, AType>::load(const std::string& filename) {
+
+    int file_descriptor = open(filename.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+    {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return nullptr;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0 || static_cast<std::size_t>(file_stat.st_size) < MODEL_HEADER_BYTES)
+    {
+        std::cerr << "Error: " << filename << " is not a model file" << std::endl;
+        close(file_descriptor);
+        return nullptr;
+    }
+
+    const std::size_t file_size = file_stat.st_size;
+    void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+    close(file_descriptor);
+
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Error: Cannot map file " << filename << std::endl;
+        return nullptr;
+    }
+
+    const std::shared_ptr<void> unmap(mapping, [file_size](void* ptr) { munmap(ptr, file_size); });
+    const char* file = static_cast<const char*>(mapping);
+
+    ModelHeader header;
+    std::memcpy(&header, file, sizeof(header));
+
+    if (std::memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0)
+    {
+        std::cerr << "Error: " << filename << " is not a model file" << std::endl;
+        return nullptr;
+    }
+
+    if (header.version != MODEL_VERSION)
+    {
+        std::cerr << "Error: " << filename << " has model version " << header.version << ", expected " << MODEL_VERSION << std::endl;
+        return nullptr;
+    }
+
+    if ((header.item_size != sizeof(float) && header.item_size != sizeof(double)) || header.metric != MODEL_METRIC_EUCLIDEAN)
+    {
+        std::cerr << "Error: " << filename << " has an unsupported dtype or metric" << std::endl;
+        return nullptr;
+    }
+
+    const std::uint64_t n_values = header.n_cluster * header.row_stride;
+    if (header.n_cluster == 0 || header.n_features == 0 || header.row_stride < header.n_features
+        || header.n_cluster > static_cast<std::uint64_t>(std::numeric_limits<int>::max())
+        || n_values / header.n_cluster != header.row_stride
+        || n_values > (file_size - MODEL_HEADER_BYTES) / header.item_size)
+    {
+        std::cerr << "Error: " << filename << " is truncated or has an invalid shape" << std::endl;
+        return nullptr;
+    }
+
+    std::optional<int> model_seed;
+    if (header.has_seed)
+    {
+        model_seed = static_cast<int>(header.seed);
+    }
+
+    auto model = std::make_unique<Parallel_KMeans>(static_cast<int>(header.n_cluster), static_cast<int>(header.max_iter), header.tol, model_seed);
+    const char* values = file + MODEL_HEADER_BYTES;
+
+    // the centroids are copied out of the mapping into the aligned padded rows (k * d values)
+    // a model saved with the other floating point type is converted on the way
+    bool loaded;
+    if (header.item_size == sizeof(FType))
+    {
+        loaded = model->setCentroids(reinterpret_cast<const FType*>(values), header.n_cluster, header.n_features, header.row_stride);
+    }
+    else if (header.item_size == sizeof(float))
+    {
+        const float* source = reinterpret_cast<const float*>(values);
+        std::vector<FType> converted(source, source + n_values);
+        loaded = model->setCentroids(converted.data(), header.n_cluster, header.n_features, header.row_stride);
+    }
+    else
+    {
+        const double* source = reinterpret_cast<const double*>(values);
+        std::vector<FType> converted(source, source + n_values);
+        loaded = model->setCentroids(converted.data(), header.n_cluster, header.n_features, header.row_stride);
+    }
+
+    if (!loaded)
+    {
+        return nullptr;
+    }
+
+    model->n_iter = header.n_iter;
+    model->inertia = header.inertia;
+    model->deterministic = header.deterministic != 0;
+
+    // checkpoints also hold the state of the random number generator that reinitializes empty clusters
+    if (header.rng_bytes > 0)
+    {
+        if (header.rng_offset < MODEL_HEADER_BYTES || header.rng_offset > file_size || header.rng_bytes > file_size - header.rng_offset)
+        {
+            std::cerr << "Error: " << filename << " is truncated or has an invalid shape" << std::endl;
+            return nullptr;
+        }
+
+        std::istringstream rng_state(std::string(file + header.rng_offset, header.rng_bytes));
+        rng_state >> model->gen;
+        model->checkpoint_rows = header.rows;
+    }
+
+    std::cout << "Loaded model " << filename << " with " << header.n_cluster << " centroids of " << header.n_features << " features" << std::endl;
+    return model;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+std::unique_ptr<Parallel_KMeans<FType, IType, AType>> Parallel_KMeans<FType, IType, AType>::resume(const std::string& filename) {
+
+    std::unique_ptr<Parallel_KMeans> model = load(filename);
+
+    if (model && model->checkpoint_rows == 0)
+    {
+        std::cerr << "Error: " << filename << " is a model but not a checkpoint" << std::endl;
+        return nullptr;
+    }
+
+    if (model)
+    {
+        model->resume_iter = model->n_iter;
+        std::cout << "Resuming the fit after iteration " << model->n_iter << std::endl;
+    }
+
+    return model;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::startCheckpoints() {
+
+    last_checkpoint = std::chrono::steady_clock::now();
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::checkpoint(const int iter, const IType rows) {
+
+    if (checkpoint_file.empty())
+    {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool iterations_due = checkpoint_every > 0 && iter % checkpoint_every == 0;
+    const bool time_due = checkpoint_seconds > 0 && std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_seconds;
+
+    if (!iterations_due && !time_due)
+    {
+        return;
+    }
+
+    // the previous checkpoint is normally written long ago, this only waits if the disk can not keep up
+    finishCheckpoints();
+
+    // only the k * d centroids and the RNG state are copied here, the file is written by another thread
+    ModelHeader header = modelHeader(*this, iter);
+    header.rows = rows;
+
+    std::ostringstream rng_state;
+    rng_state << gen;
+
+    pending_checkpoint = std::async(std::launch::async, [filename = checkpoint_file, header, snapshot = centroids, state = rng_state.str()]() {
+        return writeModelFile(filename, header, snapshot.data(), snapshot.size(), state);
+    });
+
+    last_checkpoint = now;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::finishCheckpoints() {
+
+    if (pending_checkpoint.valid())
+    {
+        pending_checkpoint.get();
+    }
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::cancel() {
+
+    if (fit_running.load())
+    {
+        cancel_requested = true;
+    }
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::prepareFit() {
+
+    cancel_requested = false;
+    fit_running = true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::startRun() {
+
+    // a run marked by prepareFit keeps the cancel that arrived before it started, any other request is stale
+    if (!fit_running.exchange(true))
+    {
+        cancel_requested = false;
+    }
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::finishRun() {
+
+    fit_running = false;
+    cancel_requested = false;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::stopRequested(const int iter) {
+
+    if (!cancel_requested.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    std::cout << "Fit cancelled after " << iter - 1 << " iterations" << std::endl;
+    this->n_iter = iter - 1;
+    this->cancelled = true;
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::warmStart(const IType rows, const IType n_cols) {
+
+    if (resume_iter > 0)
+    {
+        if (n_features == n_cols && checkpoint_rows == rows)
+        {
+            return true;
+        }
+
+        std::cerr << "The checkpoint was written for " << checkpoint_rows << " rows of " << n_features
+                  << " features but the data has " << rows << " rows of " << n_cols << " features, starting a new fit" << std::endl;
+        resume_iter = 0;
+    }
+
+    if (!warm_start)
+    {
+        return false;
+    }
+
+    if (n_features != n_cols || centroids.size() != n_cluster * alignedRowSize<FType>(n_cols))
+    {
+        std::cout << "warm_start is set but there are no centroids with " << n_cols << " features, sampling random rows" << std::endl;
+        return false;
+    }
+
+    std::cout << "Starting from the current centroids (warm start)" << std::endl;
+    return true;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+int Parallel_KMeans<FType, IType, AType>::nearestCentroid(const FType* data_ptr, const IType cols, FType& min_distance) const {
+
+    // resets for each data point to find it's min distance
+    min_distance = std::numeric_limits<FType>::max();
+    int best_centroid_idx = 0;
+
+    for (int centroid_idx = 0; centroid_idx < n_cluster; ++centroid_idx){
+
+        // each thread gets a ptr to the current centroid it is processing 
+        const FType* centroid_ptr = &centroids[centroid_idx * cols];
+        FType distance = squaredDistance(data_ptr, centroid_ptr, cols);
+
+        // calcuate the sqrt of the distance later once min distance is found so save some computation time
+        // fiding the min distance does not change 
+        if (distance < min_distance){
+            min_distance = distance;
+            best_centroid_idx = centroid_idx;
+        }
+
+    }
+
+    return best_centroid_idx;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::assignCentroids(
+    const FType* data, 
+    IType rows, 
+    IType cols
+) {
+
+    // once the centroids do not fit into the cache anymore they would be streamed from memory for every point
+    if (n_cluster * cols * sizeof(FType) > centroid_tile_bytes)
+    {
+        assignCentroidsTiled(data, rows, cols);
+        return;
+    }
+
+    // find the new centroid for every data point
+    this->inertia = assignPoints(rows, [&](const IType point) {
+
+        FType min_distance;
+        // Each Thread gets a ptr to the point it is currently processing
+        const FType* data_ptr = &data[point * cols];
+        labels[point] = nearestCentroid(data_ptr, cols, min_distance);
+
+        return min_distance;
+    });
+
+
+    #ifdef DEBUG
+    std::cout << "Assign Centroids Labels " << std::endl;
+
+    for (IType i = 0; i < labels.size(); ++i)
+    {
+        std::cout << labels[i] << " ";
+    }
+
+    std::cout << std::endl;
+    #endif
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::assignCentroidsTiled(
+    const FType* data, 
+    const IType rows, 
+    const IType cols){
+
+    // points x centroids are processed in tiles: a tile of centroids of about centroid_tile_bytes stays in the
+    // cache while a tile of ASSIGN_POINT_TILE points is compared against it, so every centroid is read from
+    // memory once per point tile instead of once per point
+    const int centroid_tile = std::max<IType>(1, centroid_tile_bytes / (cols * sizeof(FType)));
+    const IType n_point_tiles = (rows + ASSIGN_POINT_TILE - 1) / ASSIGN_POINT_TILE;
+    const int n_clusters = n_cluster;
+
+    point_distances.resize(rows);
+
+    parallelFor(n_point_tiles, 1, [&](const IType first_tile, const IType last_tile, const int) {
+
+        for (IType tile = first_tile; tile < last_tile; ++tile)
+        {
+            const IType first_point = tile * ASSIGN_POINT_TILE;
+            const IType last_point = std::min(rows, first_point + ASSIGN_POINT_TILE);
+
+            // the running best distance and index of every point are kept in the output arrays
+            for (IType point = first_point; point < last_point; ++point)
+            {
+                point_distances[point] = std::numeric_limits<FType>::max();
+                labels[point] = 0;
+            }
+
+            for (int first_centroid = 0; first_centroid < n_clusters; first_centroid += centroid_tile)
+            {
+                const int last_centroid = std::min(n_clusters, first_centroid + centroid_tile);
+
+                for (IType point = first_point; point < last_point; ++point)
+                {
+                    const FType* data_ptr = &data[point * cols];
+                    FType min_distance = point_distances[point];
+                    int best_centroid_idx = labels[point];
+
+                    // the tiles are visited in increasing order so ties resolve to the same centroid as the untiled path
+                    for (int centroid_idx = first_centroid; centroid_idx < last_centroid; ++centroid_idx)
+                    {
+                        FType distance = squaredDistance(data_ptr, &centroids[centroid_idx * cols], cols);
+
+                        if (distance < min_distance)
+                        {
+                            min_distance = distance;
+                            best_centroid_idx = centroid_idx;
+                        }
+                    }
+
+                    point_distances[point] = min_distance;
+                    labels[point] = best_centroid_idx;
+                }
+            }
+        }
+    });
+
+    // the inertia is summed in a second pass so the deterministic mode applies to the tiled path as well
+    this->inertia = assignPoints(rows, [&](const IType point) { return point_distances[point]; });
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+template <typename PointAssigner>
+double Parallel_KMeans<FType, IType, AType>::assignPoints(const IType rows, PointAssigner assign_point){
+
+    double inertia_shared = 0; 
+
+    if (!deterministic)
+    {
+        // every slot adds up its chunks on its own cache line, the slots are summed once all chunks are done
+        const IType inertia_stride = CACHE_LINE_SIZE / sizeof(double);
+        const IType n_slots = parallelSlots();
+        slot_inertia.assign(n_slots * inertia_stride, 0);
+
+        parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int slot) {
+
+            double chunk_inertia = 0;
+
+            for (IType point = first; point < last; ++point)
+            {
+                // the norm expansion of the sparse path can become slightly negative through cancellation
+                chunk_inertia += std::sqrt(std::max(assign_point(point), FType(0)));
+            }
+
+            slot_inertia[slot * inertia_stride] += chunk_inertia;
+        });
+
+        for (IType slot = 0; slot < n_slots; ++slot)
+        {
+            inertia_shared += slot_inertia[slot * inertia_stride];
+        }
+
+        return inertia_shared;
+    }
+
+    // deterministic mode: every block sums its points in order and the blocks are added in a fixed tree order
+    // so the inertia does not depend on the number of threads
+    const IType block_rows = deterministicBlockRows(rows, 1);
+    const IType n_blocks = (rows + block_rows - 1) / block_rows;
+    std::vector<double> block_inertia(n_blocks, 0);
+
+    parallelFor(n_blocks, 1, [&](const IType first_block, const IType last_block, const int) {
+
+        for (IType block = first_block; block < last_block; ++block)
+        {
+            const IType end = std::min(rows, (block + 1) * block_rows);
+            double block_sum = 0;
+
+            for (IType point = block * block_rows; point < end; ++point)
+            {
+                block_sum += std::sqrt(std::max(assign_point(point), FType(0)));
+            }
+
+            block_inertia[block] = block_sum;
+        }
+    });
+
+    for (IType stride = 1; stride < n_blocks; stride *= 2)
+    {
+        for (IType block = 0; block + stride < n_blocks; block += 2 * stride)
+        {
+            block_inertia[block] += block_inertia[block + stride];
+        }
+    }
+
+    inertia_shared = block_inertia[0];
+
+    return inertia_shared;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+IType Parallel_KMeans<FType, IType, AType>::deterministicBlockRows(const IType rows, const IType block_size) const {
+
+    // the block layout may only depend on the problem size and never on the number of threads
+    // the number of blocks is bounded so the per block partial sums never use more than DETERMINISTIC_MAX_ELEMENTS
+    IType max_blocks = std::max<IType>(1, std::min<IType>(DETERMINISTIC_MAX_BLOCKS, DETERMINISTIC_MAX_ELEMENTS / std::max<IType>(1, block_size)));
+    IType block_rows = std::max<IType>(DETERMINISTIC_BLOCK_ROWS, (rows + max_blocks - 1) / max_blocks);
+
+    return block_rows;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+template <typename RowAccumulator>
+void Parallel_KMeans<FType, IType, AType>::reduceCentroidSums(const IType rows, const IType cols, RowAccumulator accumulate_row){
+
+    const int n_clusters = n_cluster;
+    const IType centroid_size = n_clusters * cols;
+
+    // the buffers are members and keep their capacity so only the first iteration of a fit allocates
+    centroid_sums.resize(centroid_size);
+    cluster_counts.resize(n_clusters);
+
+    if (deterministic)
+    {
+        reduceCentroidSumsDeterministic(rows, cols, accumulate_row);
+        return;
+    }
+
+    // every thread slice starts on its own cache line so the threads never write into the same line
+    const IType n_threads = parallelSlots();
+    const IType sums_stride = paddedSize(centroid_size, CACHE_LINE_SIZE / sizeof(AType));
+    const IType counts_stride = paddedSize(n_clusters, CACHE_LINE_SIZE / sizeof(int));
+
+    if (n_threads * sums_stride * sizeof(AType) > reduction_memory_limit)
+    {
+        // memory bounded variant: no private sums, every owner has a contiguous range of clusters and
+        // only accumulates the points assigned to them directly into the shared sums
+        std::fill(centroid_sums.begin(), centroid_sums.end(), 0);
+        std::fill(cluster_counts.begin(), cluster_counts.end(), 0);
+
+        parallelFor(n_threads, 1, [&](const IType first_owner, const IType last_owner, const int) {
+
+            const int first_cluster = static_cast<long>(first_owner) * n_clusters / n_threads;
+            const int last_cluster = static_cast<long>(last_owner) * n_clusters / n_threads;
+
+            for (IType point = 0; point < rows; ++point)
+            {
+                const int cluster = labels[point];
+
+                if (cluster >= first_cluster && cluster < last_cluster)
+                {
+                    cluster_counts[cluster] += 1;
+                    accumulate_row(point, &centroid_sums[cluster * cols]);
+                }
+            }
+        });
+
+        return;
+    }
+
+    reduction_sums.resize(n_threads * sums_stride);
+    reduction_counts.resize(n_threads * counts_stride);
+
+    // the slices are zeroed by the threads that use them, a slot that gets no rows just adds zeros below
+    parallelFor(n_threads, 1, [&](const IType first_slot, const IType last_slot, const int) {
+
+        std::fill(&reduction_sums[first_slot * sums_stride], &reduction_sums[last_slot * sums_stride], 0);
+        std::fill(&reduction_counts[first_slot * counts_stride], &reduction_counts[last_slot * counts_stride], 0);
+    });
+
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int slot) {
+
+        AType* sums_private = &reduction_sums[slot * sums_stride];
+        int* counts_private = &reduction_counts[slot * counts_stride];
+
+        for (IType point = first; point < last; ++point)
+        {
+            int cluster = labels[point];
+            counts_private[cluster] += 1;
+            accumulate_row(point, &sums_private[cluster * cols]);
+        }
+    });
+
+    // column partitioned reduction: every slice is a cache line aligned part of the k*d sums (and of the counts)
+    // that is added up over all threads, so the merge runs in parallel instead of one thread at a time
+    const IType slice = paddedSize((centroid_size + n_threads - 1) / n_threads, CACHE_LINE_SIZE / sizeof(AType));
+
+    parallelFor(n_threads, 1, [&](const IType first_slice, const IType last_slice, const int) {
+
+        const IType begin = std::min(centroid_size, first_slice * slice);
+        const IType end = std::min(centroid_size, last_slice * slice);
+
+        std::fill(centroid_sums.begin() + begin, centroid_sums.begin() + end, 0);
+
+        for (IType other = 0; other < n_threads; ++other)
+        {
+            const AType* sums_other = &reduction_sums[other * sums_stride];
+
+            #pragma omp simd
+            for (IType element = begin; element < end; ++element)
+            {
+                centroid_sums[element] += sums_other[element];
+            }
+        }
+
+        const int first_cluster = static_cast<long>(first_slice) * n_clusters / n_threads;
+        const int last_cluster = static_cast<long>(last_slice) * n_clusters / n_threads;
+
+        for (int cluster = first_cluster; cluster < last_cluster; ++cluster)
+        {
+            int count = 0;
+
+            for (IType other = 0; other < n_threads; ++other)
+            {
+                count += reduction_counts[other * counts_stride + cluster];
+            }
+
+            cluster_counts[cluster] = count;
+        }
+    });
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+template <typename RowAccumulator>
+void Parallel_KMeans<FType, IType, AType>::reduceCentroidSumsDeterministic(const IType rows, const IType cols, RowAccumulator accumulate_row){
+
+    // fixed size row blocks each get their own partial sums which are then
+    // merged pairwise (block b += block b + stride) so the order of every addition is fixed
+    const int n_clusters = n_cluster;
+    const IType centroid_size = n_clusters * cols;
+    const IType block_rows = deterministicBlockRows(rows, centroid_size);
+    const IType n_blocks = (rows + block_rows - 1) / block_rows;
+
+    reduction_sums.resize(n_blocks * centroid_size);
+    reduction_counts.resize(n_blocks * n_clusters);
+
+    parallelFor(n_blocks, 1, [&](const IType first_block, const IType last_block, const int) {
+
+        for (IType block = first_block; block < last_block; ++block)
+        {
+            AType* block_sums_ptr = &reduction_sums[block * centroid_size];
+            int* block_counts_ptr = &reduction_counts[block * n_clusters];
+            const IType end = std::min(rows, (block + 1) * block_rows);
+
+            std::fill(block_sums_ptr, block_sums_ptr + centroid_size, 0);
+            std::fill(block_counts_ptr, block_counts_ptr + n_clusters, 0);
+
+            for (IType point = block * block_rows; point < end; ++point)
+            {
+                int cluster = labels[point];
+                block_counts_ptr[cluster] += 1;
+                accumulate_row(point, &block_sums_ptr[cluster * cols]);
+            }
+        }
+    });
+
+    // every level of the tree is split over the pairs and the elements so the last levels stay parallel
+    for (IType stride = 1; stride < n_blocks; stride *= 2)
+    {
+        const IType n_pairs = (n_blocks - stride + 2 * stride - 1) / (2 * stride);
+
+        parallelFor(n_pairs * centroid_size, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+            for (IType idx = first; idx < last; ++idx)
+            {
+                const IType block = (idx / centroid_size) * 2 * stride;
+                const IType element = idx % centroid_size;
+                reduction_sums[block * centroid_size + element] += reduction_sums[(block + stride) * centroid_size + element];
+            }
+        });
+
+        parallelFor(n_pairs * n_clusters, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+            for (IType idx = first; idx < last; ++idx)
+            {
+                const IType block = (idx / n_clusters) * 2 * stride;
+                const IType cluster = idx % n_clusters;
+                reduction_counts[block * n_clusters + cluster] += reduction_counts[(block + stride) * n_clusters + cluster];
+            }
+        });
+    }
+
+    std::copy(reduction_sums.begin(), reduction_sums.begin() + centroid_size, centroid_sums.begin());
+    std::copy(reduction_counts.begin(), reduction_counts.begin() + n_clusters, cluster_counts.begin());
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::updateCentroids(
+    const FType* data, 
+    std::vector<FType, AlignedAllocator<FType>>& new_centroids,
+    const IType rows, 
+    const IType cols)
+    {
+
+
+    // the sums are accumulated in AType (double by default) so that a float fit does not lose the low bits
+    // of tens of thousands of added rows, otherwise the rounding noise keeps the change above the tolerance
+    reduceCentroidSums(rows, cols, [&](const IType point, AType* new_centroids_partial_ptr) {
+
+        const FType* data_ptr = &data[point * cols];
+
+        #pragma omp simd
+        for (IType col_idx = 0; col_idx < cols; ++col_idx)
+        {
+            new_centroids_partial_ptr[col_idx] += data_ptr[col_idx];
+        }
+    });
+
+    for (int cluster_idx = 0; cluster_idx < this->n_cluster; ++cluster_idx){
+
+        FType* new_centroids_ptr = &new_centroids[cluster_idx * cols];
+        const AType* centroid_sums_ptr = &centroid_sums[cluster_idx * cols];
+
+        if (cluster_counts[cluster_idx] > 0)
+        {
+            // the division happens in AType as well only the final mean is rounded to FType
+            const AType count = cluster_counts[cluster_idx];
+
+            #pragma omp simd
+            for (IType col_idx = 0; col_idx < cols; ++col_idx)
+            {
+                new_centroids_ptr[col_idx] = static_cast<FType>(centroid_sums_ptr[col_idx] / count);
+            }
+        }
+
+        else
+        {
+            ReinitializeCentroids(data, new_centroids, cluster_idx, rows, cols);
+        }
+
+    }
+    
+    #ifdef DEBUG
+    std::cout << "Counts vector" << std::endl;
+
+    for (int i = 0; i < cluster_counts.size(); ++i)
+    {
+        std::cout << cluster_counts[i] << " ";
+    }
+
+    std::cout << std::endl;
+
+    std::cout << "Update Centroids new centroids end" << std::endl;
+
+    for (IType i = 0; i < new_centroids.size(); ++i)
+    {
+        
+        for (IType j = 0; j < new_centroids[0].size(); ++j)
+        {
+            std::cout << new_centroids[i * cols + j] << " ";
+        }
+
+        std::cout << std::endl;
+    }
+    #endif
+
+
+}
+
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+bool Parallel_KMeans<FType, IType, AType>::calculateChange(std::vector<FType, AlignedAllocator<FType>>& new_centroids, const IType cols){
+
+    #ifdef DEBUG
+    std::cout << "Calculate change this centroids " << std::endl;
+
+    for (IType i = 0; i < rows; ++i)
+    {
+        
+        for (IType j = 0; j < cols; ++j)
+        {
+            std::cout << this->centroids[i * cols + j] << " ";
+        }
+
+        std::cout << std::endl;
+    }
+
+     std::cout << "Calculate change new centroids " << std::endl;
+
+    for (IType i = 0; i < rows; ++i)
+    {
+        
+        for (IType j = 0; j < cols; ++j)
+        {
+            std::cout << new_centroids[i * cols + col] << " ";
+        }
+
+        std::cout << std::endl;
+    }
+    #endif
+
+    double epsilon = this->tol;
+    bool converged = true;
+
+    for (int centroid_idx = 0; centroid_idx < this->n_cluster; ++centroid_idx)
+    {
+        double centroids_difference = 0;
+        FType* centroids_ptr = &centroids[centroid_idx * cols];
+        FType* new_centroids_ptr = &new_centroids[centroid_idx * cols];
+
+        for (IType col_idx = 0; col_idx < cols; ++col_idx)
+        {
+            double centroids_diff = centroids_ptr[col_idx] - new_centroids_ptr[col_idx];
+            centroids_difference += centroids_diff * centroids_diff;
+
+        }
+
+        centroids_difference = std::sqrt(centroids_difference);
+
+        if (centroids_difference >= epsilon)
+        {
+
+            converged = false;
+            break;
+        
+        }
+
 
     }
 
@@ -471,9 +1981,315 @@ bool Parallel_KMeans<FType, IType>::calculateChange(std::vector<FType, AlignedAl
 
 }
 
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::initializeCentroids(const CSR_Matrix<FType, IType>& data){
+
+    // get the random initial centroids form the intial data
+    std::uniform_int_distribution<> dist{0,  static_cast<int>(data.rows - 1)};
+
+    // the centroids are dense so only the nonzeros of the sampled rows have to be scattered into them
+    std::fill(centroids.begin(), centroids.end(), 0.0);
+
+    for (int row = 0; row < n_cluster; ++row)
+    {
+        FType* centroid_ptr = &centroids[row * row_stride];
+        const IType data_row = dist(gen);
+
+        for (IType idx = data.indptr[data_row]; idx < data.indptr[data_row + 1]; ++idx)
+        {
+            centroid_ptr[data.indices[idx]] = data.values[idx];
+        }
+    }
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::ReinitializeCentroids(
+    const CSR_Matrix<FType, IType>& data, 
+    std::vector<FType, AlignedAllocator<FType>>& new_centroids, 
+    int cluster_idx){
+
+    // get the random initial centroids form the intial data
+    std::uniform_int_distribution<> dist{0,  static_cast<int>(data.rows - 1)};
+
+    FType* centroid_ptr = &new_centroids[cluster_idx * row_stride];
+    const IType data_row = dist(gen);
+
+    std::fill(centroid_ptr, centroid_ptr + row_stride, 0.0);
+
+    for (IType idx = data.indptr[data_row]; idx < data.indptr[data_row + 1]; ++idx)
+    {
+        centroid_ptr[data.indices[idx]] = data.values[idx];
+    }
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+std::vector<FType> Parallel_KMeans<FType, IType, AType>::calculateRowNorms(const CSR_Matrix<FType, IType>& data){
+
+    const IType rows = data.rows;
+    std::vector<FType> row_norms(rows, 0);
+
+    // squared norm ||x||^2 of every row, only depends on the data so it is calculated once per fit
+    parallelFor(rows, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+        for (IType row = first; row < last; ++row)
+        {
+            FType norm = 0;
+
+            for (IType idx = data.indptr[row]; idx < data.indptr[row + 1]; ++idx)
+            {
+                norm += data.values[idx] * data.values[idx];
+            }
+
+            row_norms[row] = norm;
+        }
+    });
+
+    return row_norms;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+std::vector<FType> Parallel_KMeans<FType, IType, AType>::calculateCentroidNorms(const IType cols) const {
+
+    std::vector<FType> centroid_norms(n_cluster, 0);
+
+    for (int centroid = 0; centroid < n_cluster; ++centroid)
+    {
+        const FType* centroid_ptr = &centroids[centroid * cols];
+        FType norm = 0;
+
+        #pragma omp simd reduction(+: norm)
+        for (IType col_idx = 0; col_idx < cols; ++col_idx)
+        {
+            norm += centroid_ptr[col_idx] * centroid_ptr[col_idx];
+        }
+
+        centroid_norms[centroid] = norm;
+    }
+
+    return centroid_norms;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::fit(const CSR_Matrix<FType, IType>& data){
+
+    const IType rows = data.rows;
+
+    if (rows == 0 || data.cols == 0)
+    {
+        std::cerr << "Data matrix is empty" << std::endl;
+        return;
+    }
+
+    if (!data.is_valid())
+    {
+        std::cerr << "CSR matrix is not valid check indptr, indices and values" << std::endl;
+        return;
+    }
+
+    const bool warm = warmStart(data.rows, data.cols);
+
+    // the centroids are dense and use the same padded layout as in the dense path
+    this->n_features = data.cols;
+    this->row_stride = alignedRowSize<FType>(data.cols);
+    const IType cols = row_stride;
+
+    // initialize the new centroids and the centroid member variables with 0's
+    std::vector<FType, AlignedAllocator<FType>> new_centroids(n_cluster * cols, 0);
+
+    if (!warm)
+    {
+        centroids = new_centroids;
+    }
+
+    // initiaize the labels of the points
+    this->labels.assign(rows, 0);
+
+    const std::vector<FType> row_norms = calculateRowNorms(data);
+
+    if (!warm)
+    {
+        initializeCentroids(data);
+    }
+
+    // a resumed fit continues with the iteration after the checkpoint
+    int iter = resume_iter + 1;
+    resume_iter = 0;
+    this->cancelled = false;
+    startRun();
+    startCheckpoints();
+
+    for (; iter < this->max_iter + 1 && !stopRequested(iter); ++iter){
+
+        assignCentroids(data, row_norms);
+        updateCentroids(data, new_centroids);
+        bool converged = calculateChange(new_centroids, cols);
+
+        if (converged)
+        {
+            std::cout << "Centroid positions have not changed anymore after " << iter << " iterations " 
+            << "within a tolerance of " << this->tol << std::endl;
+            this->n_iter = iter;
+            break;
+            
+        }
+        else
+        {
+            this->centroids = new_centroids;
+            checkpoint(iter, rows);
+        }
+        
+    }
+
+    if (iter > this->max_iter && !cancelled)
+    {
+        std::cout << "Maximum number of iterations has been reached" << std::endl;
+        std::cout << "Maximum number of iterations: " << this->max_iter << std::endl;
+        this->n_iter = this->max_iter;
+    }
+
+    finishCheckpoints();
+    updateCentroidNorms();
+    finishRun();
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+std::vector<int> Parallel_KMeans<FType, IType, AType>::predict(const CSR_Matrix<FType, IType>& new_data){
+
+    const IType ROWS = new_data.rows;
+    const IType COLS = row_stride;
+
+    if (ROWS == 0 || new_data.cols == 0 || new_data.cols != n_features)
+    {
+        std::cerr << "Data matrix is empty or does not match the fitted centroids" << std::endl;
+        return {};
+    }
+
+    std::vector<int> new_labels(ROWS, 0);
+    const std::vector<FType> centroid_norms = calculateCentroidNorms(COLS);
+
+    parallelFor(ROWS, PARALLEL_GRAIN, [&](const IType first, const IType last, const int) {
+
+        for (IType point = first; point < last; ++point)
+        {
+            FType min_distance = std::numeric_limits<FType>::max();
+            int best_centroid_idx = 0;
+
+            for (int centroid = 0; centroid < n_cluster; ++centroid)
+            {
+                const FType* centroids_ptr = &centroids[centroid * COLS];
+                FType dot = 0;
+
+                for (IType idx = new_data.indptr[point]; idx < new_data.indptr[point + 1]; ++idx)
+                {
+                    dot += new_data.values[idx] * centroids_ptr[new_data.indices[idx]];
+                }
+
+                // ||x||^2 is the same for every centroid and can be dropped when only the argmin is needed
+                FType distance = centroid_norms[centroid] - 2 * dot;
+
+                if (distance < min_distance)
+                {
+                    min_distance = distance;
+                    best_centroid_idx = centroid;
+                }
+            }
+
+            new_labels[point] = best_centroid_idx;
+        }
+    });
+
+    return new_labels;
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::assignCentroids(const CSR_Matrix<FType, IType>& data, const std::vector<FType>& row_norms){
+
+    const std::vector<FType> centroid_norms = calculateCentroidNorms(row_stride);
+
+    // ||x - c||^2 = ||x||^2 + ||c||^2 - 2 x.c where the dot product only runs over the nonzeros of x
+    this->inertia = assignPoints(data.rows, [&](const IType point) {
+
+        FType min_distance = std::numeric_limits<FType>::max();
+        int best_centroid_idx = 0;
+
+        const IType begin = data.indptr[point];
+        const IType end = data.indptr[point + 1];
+
+        for (int centroid_idx = 0; centroid_idx < n_cluster; ++centroid_idx)
+        {
+            const FType* centroid_ptr = &centroids[centroid_idx * row_stride];
+            FType dot = 0;
+
+            for (IType idx = begin; idx < end; ++idx)
+            {
+                dot += data.values[idx] * centroid_ptr[data.indices[idx]];
+            }
+
+            FType distance = row_norms[point] + centroid_norms[centroid_idx] - 2 * dot;
+
+            if (distance < min_distance)
+            {
+                min_distance = distance;
+                best_centroid_idx = centroid_idx;
+            }
+        }
+
+        labels[point] = best_centroid_idx;
+
+        return min_distance;
+    });
+
+}
+
+template <std::floating_point FType, std::integral IType, std::floating_point AType>
+void Parallel_KMeans<FType, IType, AType>::updateCentroids(const CSR_Matrix<FType, IType>& data, std::vector<FType, AlignedAllocator<FType>>& new_centroids){
+
+    const IType rows = data.rows;
+    const IType cols = row_stride;
+
+    // only the nonzeros of every point are scattered into the partial sums
+    reduceCentroidSums(rows, cols, [&](const IType point, AType* new_centroids_partial_ptr) {
+
+        for (IType idx = data.indptr[point]; idx < data.indptr[point + 1]; ++idx)
+        {
+            new_centroids_partial_ptr[data.indices[idx]] += data.values[idx];
+        }
+    });
+
+    for (int cluster_idx = 0; cluster_idx < this->n_cluster; ++cluster_idx){
+
+        FType* new_centroids_ptr = &new_centroids[cluster_idx * cols];
+        const AType* centroid_sums_ptr = &centroid_sums[cluster_idx * cols];
+
+        if (cluster_counts[cluster_idx] > 0)
+        {
+            // the division happens in AType as well only the final mean is rounded to FType
+            const AType count = cluster_counts[cluster_idx];
+
+            #pragma omp simd
+            for (IType col_idx = 0; col_idx < cols; ++col_idx)
+            {
+                new_centroids_ptr[col_idx] = static_cast<FType>(centroid_sums_ptr[col_idx] / count);
+            }
+        }
+
+        else
+        {
+            ReinitializeCentroids(data, new_centroids, cluster_idx);
+        }
+
+    }
+
+}
+
  
-template class Parallel_KMeans<float, std::size_t>;
-template class Parallel_KMeans<float, unsigned int>;
-template class Parallel_KMeans<double, std::size_t>;
-template class Parallel_KMeans<double, unsigned int>;
+template class Parallel_KMeans<float, std::size_t, double>;
+template class Parallel_KMeans<float, unsigned int, double>;
+template class Parallel_KMeans<float, std::size_t, float>;
+template class Parallel_KMeans<float, unsigned int, float>;
+template class Parallel_KMeans<double, std::size_t, double>;
+template class Parallel_KMeans<double, unsigned int, double>;
 
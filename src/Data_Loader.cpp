@@ -0,0 +1,1240 @@
+#include <Data_Loader.h>
+#include <Dataset.h>
+#include <Aligned_Allocator.h>
+#include <Dataset_Cache.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <atomic>
+#include <zlib.h>
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+// size of the blocks read from the (gzipped) file, lines longer than this grow the buffer
+constexpr std::size_t READ_CHUNK_SIZE = std::size_t(1) << 22;
+
+// case insensitive check whether the line starts with the keyword (e.g. @data, @DATA, @Data)
+bool startsWithKeyword(const char* begin, const char* end, std::string_view keyword) {
+
+    if (static_cast<std::size_t>(end - begin) < keyword.size())
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < keyword.size(); ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(begin[i])) != keyword[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const char* skipSpaces(const char* ptr, const char* end) {
+
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+    {
+        ++ptr;
+    }
+
+    return ptr;
+}
+
+// parses one field in place, ARFF missing values '?' are read as 0 and quotes around a value are skipped
+// returns nullptr if the field is not a number
+template <typename T>
+const char* parseField(const char* ptr, const char* end, T& value) {
+
+    ptr = skipSpaces(ptr, end);
+
+    bool quoted = ptr < end && (*ptr == '\'' || *ptr == '"');
+    if (quoted)
+    {
+        ++ptr;
+    }
+
+    if (ptr < end && *ptr == '?')
+    {
+        value = 0;
+        ++ptr;
+    }
+    else
+    {
+        auto [next, error] = std::from_chars(ptr, end, value);
+        if (error != std::errc())
+        {
+            return nullptr;
+        }
+        ptr = next;
+    }
+
+    if (quoted && ptr < end && (*ptr == '\'' || *ptr == '"'))
+    {
+        ++ptr;
+    }
+
+    return skipSpaces(ptr, end);
+}
+
+template <std::floating_point FType>
+struct DelimitedFormat {
+
+    const LabelColumn label_column;
+    // the feature statistics for scaling are only accumulated if the caller asked for them
+    const bool collect_statistics;
+
+    bool in_header = true;
+    bool is_arff = false;
+    std::size_t n_attributes = 0;
+    std::size_t n_fields = 0;
+    std::size_t cols = 0;
+    std::size_t stride = 0;
+
+    explicit DelimitedFormat(const LabelColumn label, const bool statistics = false) : label_column{label}, collect_statistics{statistics} {}
+
+    void setFields(const std::size_t fields) {
+
+        n_fields = fields;
+        cols = label_column == LabelColumn::None ? fields : fields - 1;
+        stride = alignedRowSize<FType>(cols);
+    }
+
+    // consumes the header lines at the start of [begin, end) which only holds complete lines
+    // returns the first data line or end if the header continues in the next block
+    const char* parseHeader(const char* begin, const char* end) {
+
+        while (in_header && begin < end)
+        {
+            const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            const char* line_end = newline == nullptr ? end : newline;
+            const char* next_line = newline == nullptr ? end : newline + 1;
+
+            if (line_end > begin && line_end[-1] == '\r')
+            {
+                --line_end;
+            }
+
+            const char* line = skipSpaces(begin, line_end);
+
+            if (line == line_end || *line == '%')
+            {
+                begin = next_line;
+                continue;
+            }
+
+            if (*line == '@')
+            {
+                is_arff = true;
+
+                if (startsWithKeyword(line, line_end, "@attribute"))
+                {
+                    n_attributes += 1;
+                }
+                else if (startsWithKeyword(line, line_end, "@data"))
+                {
+                    std::cout << "Found @Data line with " << n_attributes << " attributes" << std::endl;
+                    in_header = false;
+                    setFields(n_attributes);
+                }
+
+                begin = next_line;
+                continue;
+            }
+
+            // CSV files: the number of fields comes from the first line, which is skipped if it is a header
+            in_header = false;
+            setFields(std::count(line, line_end, ',') + 1);
+
+            FType first_value;
+            if (parseField(line, line_end, first_value) == nullptr)
+            {
+                std::cout << "Skipping CSV header line" << std::endl;
+                begin = next_line;
+            }
+        }
+
+        return begin;
+    }
+
+};
+
+// a block of complete lines of the file and the rows parsed from it in the padded layout
+template <std::floating_point FType>
+struct ParsedBlock {
+
+    std::vector<char> text;
+    std::size_t text_begin = 0;
+    std::size_t text_end = 0;
+
+    std::vector<FType, AlignedAllocator<FType>> values;
+    std::vector<int> labels;
+    std::size_t rows = 0;
+    std::size_t skipped_rows = 0;
+
+    FeatureStatistics statistics;
+
+};
+
+// parses the fields of one line into row_ptr (cols values) and label, returns false for a malformed line
+template <std::floating_point FType>
+bool parseFields(const DelimitedFormat<FType>& format, const char* ptr, const char* end, FType* row_ptr, double& label) {
+
+    const std::size_t label_field = format.label_column == LabelColumn::First ? 0 : format.n_fields - 1;
+
+    std::size_t field = 0;
+    std::size_t col = 0;
+
+    while (ptr != nullptr)
+    {
+        if (format.label_column != LabelColumn::None && field == label_field)
+        {
+            ptr = parseField(ptr, end, label);
+        }
+        else if (col < format.cols)
+        {
+            ptr = parseField(ptr, end, row_ptr[col]);
+            col += 1;
+        }
+        else
+        {
+            ptr = nullptr;
+            break;
+        }
+
+        field += 1;
+
+        if (ptr == nullptr || ptr == end)
+        {
+            break;
+        }
+
+        ptr = *ptr == ',' ? ptr + 1 : nullptr;
+    }
+
+    return ptr != nullptr && field == format.n_fields;
+}
+
+template <std::floating_point FType>
+void parseRow(const DelimitedFormat<FType>& format, ParsedBlock<FType>& block, const char* ptr, const char* end) {
+
+    // the new row is written directly into the flat buffer, resize zero fills the padding
+    block.values.resize((block.rows + 1) * format.stride);
+    FType* row_ptr = block.values.data() + block.rows * format.stride;
+    double label = 0;
+
+    if (!parseFields(format, ptr, end, row_ptr, label))
+    {
+        // drop the partially written row again
+        block.values.resize(block.rows * format.stride);
+        block.skipped_rows += 1;
+        return;
+    }
+
+    if (format.label_column != LabelColumn::None)
+    {
+        block.labels.push_back(static_cast<int>(label));
+    }
+
+    block.rows += 1;
+}
+
+// parses all the lines of a block, runs as its own task so several blocks are parsed at the same time
+template <std::floating_point FType>
+void parseBlock(const DelimitedFormat<FType>& format, ParsedBlock<FType>& block) {
+
+    const char* begin = block.text.data() + block.text_begin;
+    const char* end = block.text.data() + block.text_end;
+
+    // about one row per line, the estimate only saves most of the reallocations
+    block.values.reserve(std::count(begin, end, '\n') * format.stride);
+
+    while (begin < end)
+    {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* line_end = newline == nullptr ? end : newline;
+
+        if (line_end > begin && line_end[-1] == '\r')
+        {
+            --line_end;
+        }
+
+        const char* line = skipSpaces(begin, line_end);
+
+        if (line != line_end && *line != '%')
+        {
+            parseRow(format, block, line, line_end);
+        }
+
+        begin = newline == nullptr ? end : newline + 1;
+    }
+
+    // the text is not needed anymore, only the parsed rows are kept until all blocks are done
+    std::vector<char>().swap(block.text);
+
+    // the statistics for scaling are collected while the parsed rows are still in the cache
+    if (format.collect_statistics)
+    {
+        block.statistics.accumulate(block.values.data(), block.rows, format.cols, format.stride);
+    }
+}
+
+}
+
+template <std::floating_point FType>
+bool readDelimited(const std::string& filename, Dataset<FType>& dataset, const LabelColumn label_column, const bool collect_statistics) {
+
+    // gzread reads uncompressed files transparently so plain and gzipped files share one code path
+    gzFile gz_file = gzopen(filename.c_str(), "rb");
+    if (!gz_file) {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+
+    gzbuffer(gz_file, 1 << 20);
+
+    dataset = Dataset<FType>{};
+    DelimitedFormat<FType> format(label_column, collect_statistics);
+
+    // a deque does not move its elements when it grows, so the running tasks keep valid references
+    std::deque<ParsedBlock<FType>> blocks;
+    std::atomic<std::size_t> blocks_in_flight{0};
+    bool success = true;
+
+    std::cout << "Start processing the rows" << std::endl;
+
+    // Pipeline: the thread executing the single region inflates the file block by block and cuts every block
+    // after its last newline, each block of complete lines is then parsed by a task on one of the other threads.
+    // If too many blocks are waiting the reader parses the block itself, which bounds the decompressed text in memory
+    #pragma omp parallel
+    #pragma omp single
+    {
+        const std::size_t max_in_flight = 2 * omp_get_num_threads();
+        std::vector<char> carry;
+        bool end_of_file = false;
+
+        while (!end_of_file)
+        {
+            std::vector<char> text(std::max(READ_CHUNK_SIZE, 2 * carry.size()));
+            std::memcpy(text.data(), carry.data(), carry.size());
+            std::size_t filled = carry.size();
+            const char* last_newline = nullptr;
+
+            // a single line that does not fit into the block grows it, so there is no limit on the row length
+            while (last_newline == nullptr)
+            {
+                if (filled == text.size())
+                {
+                    text.resize(text.size() * 2);
+                }
+
+                int bytes = gzread(gz_file, text.data() + filled, static_cast<unsigned int>(text.size() - filled));
+
+                if (bytes < 0)
+                {
+                    int error_number;
+                    std::cerr << "Error: Failed to read " << filename << ": " << gzerror(gz_file, &error_number) << std::endl;
+                    success = false;
+                    end_of_file = true;
+                    break;
+                }
+
+                const std::size_t searched = filled;
+                filled += bytes;
+
+                if (bytes == 0)
+                {
+                    end_of_file = true;
+                    break;
+                }
+
+                for (std::size_t idx = filled; idx > searched; --idx)
+                {
+                    if (text[idx - 1] == '\n')
+                    {
+                        last_newline = text.data() + idx - 1;
+                        break;
+                    }
+                }
+            }
+
+            // at the end of the file the last line does not need a newline
+            const std::size_t complete = last_newline == nullptr ? filled : last_newline - text.data() + 1;
+            carry.assign(text.data() + complete, text.data() + filled);
+
+            std::size_t text_begin = 0;
+            if (format.in_header)
+            {
+                text_begin = format.parseHeader(text.data(), text.data() + complete) - text.data();
+            }
+
+            if (format.in_header || text_begin == complete)
+            {
+                continue;
+            }
+
+            ParsedBlock<FType>& block = blocks.emplace_back();
+            block.text = std::move(text);
+            block.text_begin = text_begin;
+            block.text_end = complete;
+
+            blocks_in_flight += 1;
+
+            #pragma omp task default(none) shared(format, block, blocks_in_flight) if(blocks_in_flight <= max_in_flight)
+            {
+                parseBlock(format, block);
+                blocks_in_flight -= 1;
+            }
+        }
+
+        #pragma omp taskwait
+    }
+
+    if (gzclose(gz_file) != Z_OK) {
+        std::cerr << "Error: Failed to close the file" << std::endl;
+    }
+
+    // the blocks are copied in file order into one preallocated buffer
+    std::vector<std::size_t> row_offsets(blocks.size() + 1, 0);
+    std::size_t skipped_rows = 0;
+
+    for (std::size_t block_idx = 0; block_idx < blocks.size(); ++block_idx)
+    {
+        row_offsets[block_idx + 1] = row_offsets[block_idx] + blocks[block_idx].rows;
+        skipped_rows += blocks[block_idx].skipped_rows;
+        dataset.statistics.merge(blocks[block_idx].statistics);
+    }
+
+    dataset.rows = row_offsets.back();
+    dataset.cols = format.cols;
+    dataset.stride = format.stride;
+
+    // the buffer is allocated but not initialized, so its pages are only committed while the blocks are copied into
+    // it and every block is freed right after its copy, the parsed values are never held twice
+    const bool has_labels = label_column != LabelColumn::None;
+    FType* values = AlignedAllocator<FType>().allocate(dataset.rows * dataset.stride);
+    dataset.storage = std::shared_ptr<void>(values, [](void* ptr) { free(ptr); });
+    dataset.view = values;
+
+    if (has_labels)
+    {
+        dataset.labels.resize(dataset.rows);
+    }
+
+    #pragma omp parallel for default(none) shared(blocks, row_offsets, dataset, values, has_labels) schedule(dynamic, 1)
+    for (std::size_t block_idx = 0; block_idx < blocks.size(); ++block_idx)
+    {
+        ParsedBlock<FType>& block = blocks[block_idx];
+
+        // the rows of a block are already padded with zeros
+        std::copy(block.values.begin(), block.values.end(), values + row_offsets[block_idx] * dataset.stride);
+        std::vector<FType, AlignedAllocator<FType>>().swap(block.values);
+
+        if (has_labels)
+        {
+            std::copy(block.labels.begin(), block.labels.end(), dataset.labels.begin() + row_offsets[block_idx]);
+            std::vector<int>().swap(block.labels);
+        }
+    }
+
+    if (skipped_rows > 0)
+    {
+        std::cerr << "Skipped " << skipped_rows << " malformed rows, expected " << format.n_fields << " fields per row" << std::endl;
+    }
+
+    if (dataset.rows == 0)
+    {
+        std::cerr << "Error: No rows found in " << filename << std::endl;
+        success = false;
+    }
+
+    std::cout << "Row processing has ended" << std::endl;
+    std::cout << "Rows: " << dataset.rows << " Columns: " << dataset.cols << " Skipped rows: " << skipped_rows << std::endl;
+
+    return success;
+}
+
+template bool readDelimited<float>(const std::string& filename, Dataset<float>& dataset, const LabelColumn label_column, const bool collect_statistics);
+template bool readDelimited<double>(const std::string& filename, Dataset<double>& dataset, const LabelColumn label_column, const bool collect_statistics);
+
+
+namespace {
+
+// header of a .npy file, see numpy.lib.format
+struct NpyHeader {
+
+    char byte_order = 0;
+    char kind = 0;
+    std::size_t item_size = 0;
+    bool fortran_order = false;
+    std::vector<std::size_t> shape;
+    std::size_t data_offset = 0;
+
+};
+
+// finds the value that follows 'key': in the header dictionary
+const char* findNpyKey(const char* begin, const char* end, std::string_view key) {
+
+    const char* found = std::search(begin, end, key.begin(), key.end());
+    if (found == end)
+    {
+        return nullptr;
+    }
+
+    const char* colon = std::find(found + key.size(), end, ':');
+    return colon == end ? nullptr : skipSpaces(colon + 1, end);
+}
+
+bool parseNpyHeader(const char* file, const std::size_t file_size, NpyHeader& header) {
+
+    constexpr std::string_view MAGIC = "\x93NUMPY";
+
+    if (file_size < 10 || std::string_view(file, MAGIC.size()) != MAGIC)
+    {
+        std::cerr << "Error: Not a .npy file" << std::endl;
+        return false;
+    }
+
+    // version 1 stores the header length in 2 bytes, versions 2 and 3 in 4 bytes (little endian)
+    const unsigned char major_version = file[6];
+    const unsigned char* length_bytes = reinterpret_cast<const unsigned char*>(file + 8);
+    std::size_t header_length = length_bytes[0] | (length_bytes[1] << 8);
+    std::size_t prefix_length = 10;
+
+    if (major_version >= 2)
+    {
+        if (file_size < 12)
+        {
+            std::cerr << "Error: Truncated .npy header" << std::endl;
+            return false;
+        }
+
+        header_length |= (std::size_t(length_bytes[2]) << 16) | (std::size_t(length_bytes[3]) << 24);
+        prefix_length = 12;
+    }
+
+    header.data_offset = prefix_length + header_length;
+    if (header.data_offset > file_size)
+    {
+        std::cerr << "Error: Truncated .npy header" << std::endl;
+        return false;
+    }
+
+    const char* begin = file + prefix_length;
+    const char* end = file + header.data_offset;
+
+    // 'descr': '<f4'
+    const char* descr = findNpyKey(begin, end, "'descr'");
+    if (descr == nullptr || end - descr < 5 || *descr != '\'')
+    {
+        std::cerr << "Error: .npy header has no dtype" << std::endl;
+        return false;
+    }
+
+    header.byte_order = descr[1];
+    header.kind = descr[2];
+    std::from_chars(descr + 3, end, header.item_size);
+
+    // 'fortran_order': False
+    const char* fortran_order = findNpyKey(begin, end, "'fortran_order'");
+    if (fortran_order == nullptr)
+    {
+        std::cerr << "Error: .npy header has no fortran_order" << std::endl;
+        return false;
+    }
+
+    header.fortran_order = *fortran_order == 'T';
+
+    // 'shape': (rows, cols)
+    const char* shape = findNpyKey(begin, end, "'shape'");
+    if (shape == nullptr || *shape != '(')
+    {
+        std::cerr << "Error: .npy header has no shape" << std::endl;
+        return false;
+    }
+
+    const char* shape_end = std::find(shape, end, ')');
+    const char* ptr = shape + 1;
+
+    while (ptr < shape_end)
+    {
+        ptr = skipSpaces(ptr, shape_end);
+
+        std::size_t dim;
+        auto [next, error] = std::from_chars(ptr, shape_end, dim);
+        if (error != std::errc())
+        {
+            break;
+        }
+
+        header.shape.push_back(dim);
+        ptr = skipSpaces(next, shape_end);
+        ptr = ptr < shape_end && *ptr == ',' ? ptr + 1 : shape_end;
+    }
+
+    return true;
+}
+
+// only 2D C order little endian float32/float64 arrays that fit into the file can be read
+bool validateNpyHeader(const NpyHeader& header, const std::size_t file_size, const std::string& filename) {
+
+    const bool little_endian = header.byte_order == '<' || header.byte_order == '=' || header.byte_order == '|';
+    if (!little_endian || header.kind != 'f' || (header.item_size != sizeof(float) && header.item_size != sizeof(double)))
+    {
+        std::cerr << "Error: Only little endian float32 and float64 .npy files are supported" << std::endl;
+        return false;
+    }
+
+    if (header.fortran_order)
+    {
+        std::cerr << "Error: The .npy file has to be stored in C order" << std::endl;
+        return false;
+    }
+
+    if (header.shape.size() != 2)
+    {
+        std::cerr << "Error: The .npy file has to hold a 2D array, found " << header.shape.size() << " dimensions" << std::endl;
+        return false;
+    }
+
+    if (header.data_offset + header.shape[0] * header.shape[1] * header.item_size > file_size)
+    {
+        std::cerr << "Error: The .npy file is smaller than its shape" << std::endl;
+        return false;
+    }
+
+    if (header.shape[0] == 0 || header.shape[1] == 0)
+    {
+        std::cerr << "Error: No rows found in " << filename << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// converts the rows of the mapped file into the padded layout of the dataset, the padding is already zero
+template <std::floating_point FType, typename SourceType>
+void repackRows(const char* source, Dataset<FType>& dataset) {
+
+    const SourceType* source_values = reinterpret_cast<const SourceType*>(source);
+    FType* values = dataset.values.data();
+    const std::size_t rows = dataset.rows;
+    const std::size_t cols = dataset.cols;
+    const std::size_t stride = dataset.stride;
+
+    #pragma omp parallel for default(none) shared(source_values, values, rows, cols, stride) schedule(static)
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        for (std::size_t col = 0; col < cols; ++col)
+        {
+            values[row * stride + col] = static_cast<FType>(source_values[row * cols + col]);
+        }
+    }
+}
+
+}
+
+std::shared_ptr<void> mapFile(const std::string& filename, std::size_t& file_size) {
+
+    int file_descriptor = open(filename.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+    {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return nullptr;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        std::cerr << "Error: Cannot read the size of " << filename << std::endl;
+        close(file_descriptor);
+        return nullptr;
+    }
+
+    file_size = file_stat.st_size;
+
+    // private mapping, the data set can be written to without changing the file
+    void* mapping = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Error: Cannot map file " << filename << std::endl;
+        return nullptr;
+    }
+
+    const std::size_t mapped_size = file_size;
+    return std::shared_ptr<void>(mapping, [mapped_size](void* ptr) { munmap(ptr, mapped_size); });
+}
+
+template <std::floating_point FType>
+bool readNpy(const std::string& filename, Dataset<FType>& dataset) {
+
+    std::size_t file_size;
+    std::shared_ptr<void> storage = mapFile(filename, file_size);
+
+    if (!storage)
+    {
+        return false;
+    }
+
+    void* mapping = storage.get();
+    const char* file = static_cast<const char*>(mapping);
+
+    NpyHeader header;
+    if (!parseNpyHeader(file, file_size, header) || !validateNpyHeader(header, file_size, filename))
+    {
+        return false;
+    }
+
+    dataset = Dataset<FType>{};
+    dataset.rows = header.shape[0];
+    dataset.cols = header.shape[1];
+    dataset.stride = alignedRowSize<FType>(dataset.cols);
+
+    const char* source = file + header.data_offset;
+
+    // the mapping is page aligned so the rows are aligned if the header and the row size are multiples of BYTE_ALIGNMENT
+    if (header.item_size == sizeof(FType) && dataset.stride == dataset.cols && header.data_offset % BYTE_ALIGNMENT == 0)
+    {
+        madvise(mapping, file_size, MADV_WILLNEED);
+
+        dataset.view = reinterpret_cast<FType*>(mapping) + header.data_offset / sizeof(FType);
+        dataset.storage = std::move(storage);
+
+        std::cout << "Rows: " << dataset.rows << " Columns: " << dataset.cols << " (memory mapped)" << std::endl;
+        return true;
+    }
+
+    madvise(mapping, file_size, MADV_SEQUENTIAL);
+    dataset.values.resize(dataset.rows * dataset.stride);
+
+    if (header.item_size == sizeof(float))
+    {
+        repackRows<FType, float>(source, dataset);
+    }
+    else
+    {
+        repackRows<FType, double>(source, dataset);
+    }
+
+    std::cout << "Rows: " << dataset.rows << " Columns: " << dataset.cols << " (repacked)" << std::endl;
+    return true;
+}
+
+template bool readNpy<float>(const std::string& filename, Dataset<float>& dataset);
+template bool readNpy<double>(const std::string& filename, Dataset<double>& dataset);
+
+bool readNpyLayout(const std::string& filename, BinaryLayout& layout) {
+
+    // the mapping only reserves address space, just the pages of the header are read
+    std::size_t file_size;
+    std::shared_ptr<void> storage = mapFile(filename, file_size);
+
+    if (!storage)
+    {
+        return false;
+    }
+
+    NpyHeader header;
+    if (!parseNpyHeader(static_cast<const char*>(storage.get()), file_size, header) || !validateNpyHeader(header, file_size, filename))
+    {
+        return false;
+    }
+
+    layout.item_size = header.item_size;
+    layout.rows = header.shape[0];
+    layout.cols = header.shape[1];
+    layout.stride = header.shape[1];
+    layout.data_offset = header.data_offset;
+
+    return true;
+}
+
+
+namespace {
+
+// reads exactly size bytes, gzread handles plain files transparently
+bool readBytes(gzFile gz_file, void* buffer, const std::size_t size) {
+
+    char* ptr = static_cast<char*>(buffer);
+    std::size_t remaining = size;
+
+    while (remaining > 0)
+    {
+        const unsigned int request = static_cast<unsigned int>(std::min<std::size_t>(remaining, READ_CHUNK_SIZE));
+        int bytes = gzread(gz_file, ptr, request);
+
+        if (bytes <= 0)
+        {
+            return false;
+        }
+
+        ptr += bytes;
+        remaining -= bytes;
+    }
+
+    return true;
+}
+
+// IDX files store every value in big endian byte order
+template <typename UnsignedType>
+UnsignedType readBigEndian(const unsigned char* bytes) {
+
+    UnsignedType value = 0;
+    for (std::size_t i = 0; i < sizeof(UnsignedType); ++i)
+    {
+        value = static_cast<UnsignedType>(value << 8) | bytes[i];
+    }
+
+    return value;
+}
+
+// value of one element of an IDX file with the given type code
+double readIdxValue(const unsigned char* bytes, const unsigned char type_code) {
+
+    switch (type_code)
+    {
+        case 0x08: return bytes[0];
+        case 0x09: return static_cast<std::int8_t>(bytes[0]);
+        case 0x0B: return static_cast<std::int16_t>(readBigEndian<std::uint16_t>(bytes));
+        case 0x0C: return static_cast<std::int32_t>(readBigEndian<std::uint32_t>(bytes));
+        case 0x0D: return std::bit_cast<float>(readBigEndian<std::uint32_t>(bytes));
+        default: return std::bit_cast<double>(readBigEndian<std::uint64_t>(bytes));
+    }
+}
+
+std::size_t idxItemSize(const unsigned char type_code) {
+
+    switch (type_code)
+    {
+        case 0x08: case 0x09: return 1;
+        case 0x0B: return 2;
+        case 0x0C: case 0x0D: return 4;
+        case 0x0E: return 8;
+        default: return 0;
+    }
+}
+
+// reads the magic number and the dimensions of an IDX file
+bool readIdxHeader(gzFile gz_file, const std::string& filename, unsigned char& type_code, std::vector<std::size_t>& dims) {
+
+    unsigned char magic[4];
+    if (!readBytes(gz_file, magic, 4) || magic[0] != 0 || magic[1] != 0 || idxItemSize(magic[2]) == 0 || magic[3] == 0)
+    {
+        std::cerr << "Error: " << filename << " is not an IDX file" << std::endl;
+        return false;
+    }
+
+    type_code = magic[2];
+    std::vector<unsigned char> dim_bytes(4 * magic[3]);
+
+    if (!readBytes(gz_file, dim_bytes.data(), dim_bytes.size()))
+    {
+        std::cerr << "Error: Truncated IDX header in " << filename << std::endl;
+        return false;
+    }
+
+    dims.resize(magic[3]);
+    for (std::size_t dim = 0; dim < dims.size(); ++dim)
+    {
+        dims[dim] = readBigEndian<std::uint32_t>(&dim_bytes[4 * dim]);
+    }
+
+    return true;
+}
+
+}
+
+template <std::floating_point FType>
+bool readIdx(const std::string& images_filename, const std::string& labels_filename, Dataset<FType>& dataset) {
+
+    gzFile gz_file = gzopen(images_filename.c_str(), "rb");
+    if (!gz_file) {
+        std::cerr << "Error: Cannot open file " << images_filename << std::endl;
+        return false;
+    }
+
+    gzbuffer(gz_file, 1 << 20);
+
+    unsigned char type_code;
+    std::vector<std::size_t> dims;
+
+    if (!readIdxHeader(gz_file, images_filename, type_code, dims))
+    {
+        gzclose(gz_file);
+        return false;
+    }
+
+    // the first dimension are the rows, all the others (e.g. 28 x 28 pixels) are flattened into the columns
+    dataset = Dataset<FType>{};
+    dataset.rows = dims[0];
+    dataset.cols = 1;
+    for (std::size_t dim = 1; dim < dims.size(); ++dim)
+    {
+        dataset.cols *= dims[dim];
+    }
+    dataset.stride = alignedRowSize<FType>(dataset.cols);
+    dataset.values.resize(dataset.rows * dataset.stride);
+
+    // the rows are converted block by block straight into the padded buffer
+    const std::size_t item_size = idxItemSize(type_code);
+    const std::size_t row_bytes = dataset.cols * item_size;
+    const std::size_t block_rows = std::max<std::size_t>(1, READ_CHUNK_SIZE / std::max<std::size_t>(1, row_bytes));
+    std::vector<unsigned char> buffer(block_rows * row_bytes);
+    bool success = true;
+
+    for (std::size_t first_row = 0; first_row < dataset.rows && success; first_row += block_rows)
+    {
+        const std::size_t n_rows = std::min(block_rows, dataset.rows - first_row);
+
+        if (!readBytes(gz_file, buffer.data(), n_rows * row_bytes))
+        {
+            std::cerr << "Error: " << images_filename << " ends after " << first_row << " rows, expected " << dataset.rows << std::endl;
+            success = false;
+            break;
+        }
+
+        if (type_code == 0x08)
+        {
+            // unsigned bytes (MNIST pixels) need no byte swapping, only a conversion
+            for (std::size_t row = 0; row < n_rows; ++row)
+            {
+                std::copy(&buffer[row * row_bytes], &buffer[row * row_bytes] + dataset.cols, dataset.row(first_row + row));
+            }
+        }
+        else
+        {
+            for (std::size_t row = 0; row < n_rows; ++row)
+            {
+                FType* row_ptr = dataset.row(first_row + row);
+                for (std::size_t col = 0; col < dataset.cols; ++col)
+                {
+                    row_ptr[col] = static_cast<FType>(readIdxValue(&buffer[row * row_bytes + col * item_size], type_code));
+                }
+            }
+        }
+    }
+
+    gzclose(gz_file);
+
+    if (success && !labels_filename.empty())
+    {
+        gzFile labels_file = gzopen(labels_filename.c_str(), "rb");
+        if (!labels_file) {
+            std::cerr << "Error: Cannot open file " << labels_filename << std::endl;
+            return false;
+        }
+
+        if (!readIdxHeader(labels_file, labels_filename, type_code, dims))
+        {
+            gzclose(labels_file);
+            return false;
+        }
+
+        if (dims.size() != 1 || dims[0] != dataset.rows)
+        {
+            std::cerr << "Error: " << labels_filename << " does not hold one label for each of the " << dataset.rows << " rows" << std::endl;
+            gzclose(labels_file);
+            return false;
+        }
+
+        std::vector<unsigned char> label_bytes(dataset.rows * idxItemSize(type_code));
+        success = readBytes(labels_file, label_bytes.data(), label_bytes.size());
+
+        if (!success)
+        {
+            std::cerr << "Error: Truncated labels in " << labels_filename << std::endl;
+        }
+        else
+        {
+            dataset.labels.resize(dataset.rows);
+            for (std::size_t row = 0; row < dataset.rows; ++row)
+            {
+                dataset.labels[row] = static_cast<int>(readIdxValue(&label_bytes[row * idxItemSize(type_code)], type_code));
+            }
+        }
+
+        gzclose(labels_file);
+    }
+
+    std::cout << "Rows: " << dataset.rows << " Columns: " << dataset.cols << " Labels: " << dataset.labels.size() << std::endl;
+
+    return success;
+}
+
+template <std::floating_point FType>
+bool readDataset(const std::string& filename, Dataset<FType>& dataset, DataFormat format, const std::string& labels_filename, const LabelColumn label_column, const bool collect_statistics) {
+
+    if (format == DataFormat::Auto)
+    {
+        format = detectDataFormat(filename);
+    }
+
+    switch (format)
+    {
+        case DataFormat::Npy: return readNpy(filename, dataset);
+        case DataFormat::Idx: return readIdx(filename, labels_filename, dataset);
+        case DataFormat::Cache: return readDatasetCache(filename, dataset);
+        default: return readDelimited(filename, dataset, label_column, collect_statistics);
+    }
+}
+
+DataFormat detectDataFormat(const std::string& filename) {
+
+    std::string_view name = filename;
+    if (name.ends_with(".gz"))
+    {
+        name.remove_suffix(3);
+    }
+
+    if (name.ends_with(".npy"))
+    {
+        return DataFormat::Npy;
+    }
+
+    if (name.ends_with(DATASET_CACHE_EXTENSION))
+    {
+        return DataFormat::Cache;
+    }
+
+    // MNIST names its files e.g. train-images-idx3-ubyte or train-images.idx3-ubyte
+    if (name.find("idx") != std::string_view::npos && (name.ends_with("ubyte") || name.ends_with(".idx")))
+    {
+        return DataFormat::Idx;
+    }
+
+    return DataFormat::Delimited;
+}
+
+bool parseDataFormat(const std::string& name, DataFormat& format) {
+
+    if (name == "auto") format = DataFormat::Auto;
+    else if (name == "arff" || name == "csv") format = DataFormat::Delimited;
+    else if (name == "npy") format = DataFormat::Npy;
+    else if (name == "idx") format = DataFormat::Idx;
+    else if (name == "cache") format = DataFormat::Cache;
+    else return false;
+
+    return true;
+}
+
+bool parseLabelColumn(const std::string& name, LabelColumn& label_column) {
+
+    if (name == "none") label_column = LabelColumn::None;
+    else if (name == "first") label_column = LabelColumn::First;
+    else if (name == "last") label_column = LabelColumn::Last;
+    else return false;
+
+    return true;
+}
+
+template bool readIdx<float>(const std::string& images_filename, const std::string& labels_filename, Dataset<float>& dataset);
+template bool readIdx<double>(const std::string& images_filename, const std::string& labels_filename, Dataset<double>& dataset);
+
+template bool readDataset<float>(const std::string& filename, Dataset<float>& dataset, DataFormat format, const std::string& labels_filename, const LabelColumn label_column, const bool collect_statistics);
+template bool readDataset<double>(const std::string& filename, Dataset<double>& dataset, DataFormat format, const std::string& labels_filename, const LabelColumn label_column, const bool collect_statistics);
+
+
+template <std::floating_point FType>
+struct DelimitedRowStream<FType>::State {
+
+    gzFile gz_file = nullptr;
+    DelimitedFormat<FType> format;
+    std::vector<char> buffer;
+    std::size_t begin = 0;
+    std::size_t filled = 0;
+    bool end_of_file = false;
+    bool failed = false;
+    std::size_t skipped_rows = 0;
+
+    explicit State(const LabelColumn label_column) : format(label_column), buffer(READ_CHUNK_SIZE) {}
+
+    // moves the unread bytes to the front and appends the next block of the file
+    void refill() {
+
+        filled -= begin;
+        std::memmove(buffer.data(), buffer.data() + begin, filled);
+        begin = 0;
+
+        if (filled == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        int bytes = gzread(gz_file, buffer.data() + filled, static_cast<unsigned int>(buffer.size() - filled));
+
+        if (bytes < 0)
+        {
+            int error_number;
+            std::cerr << "Error: Failed to read: " << gzerror(gz_file, &error_number) << std::endl;
+            failed = true;
+        }
+
+        if (bytes <= 0)
+        {
+            end_of_file = true;
+            return;
+        }
+
+        filled += bytes;
+    }
+
+};
+
+template <std::floating_point FType>
+DelimitedRowStream<FType>::DelimitedRowStream() = default;
+
+template <std::floating_point FType>
+DelimitedRowStream<FType>::~DelimitedRowStream() {
+
+    if (state && state->gz_file)
+    {
+        gzclose(state->gz_file);
+    }
+}
+
+template <std::floating_point FType>
+bool DelimitedRowStream<FType>::open(const std::string& filename, const LabelColumn label_column) {
+
+    if (state && state->gz_file)
+    {
+        gzclose(state->gz_file);
+    }
+
+    state = std::make_unique<State>(label_column);
+    state->gz_file = gzopen(filename.c_str(), "rb");
+
+    if (!state->gz_file) {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        state->failed = true;
+        return false;
+    }
+
+    gzbuffer(state->gz_file, 1 << 20);
+
+    // the header only consumes complete lines, the rest of the buffer is kept for readRows
+    while (state->format.in_header && !state->end_of_file)
+    {
+        state->refill();
+
+        const char* data = state->buffer.data();
+        const char* end = data + state->filled;
+
+        if (!state->end_of_file)
+        {
+            while (end > data + state->begin && end[-1] != '\n')
+            {
+                --end;
+            }
+        }
+
+        state->begin = state->format.parseHeader(data + state->begin, end) - data;
+    }
+
+    if (state->format.in_header || state->failed)
+    {
+        std::cerr << "Error: No data found in " << filename << std::endl;
+        state->failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+template <std::floating_point FType>
+std::size_t DelimitedRowStream<FType>::cols() const {
+
+    return state ? state->format.cols : 0;
+}
+
+template <std::floating_point FType>
+bool DelimitedRowStream<FType>::good() const {
+
+    return state && !state->failed;
+}
+
+template <std::floating_point FType>
+std::size_t DelimitedRowStream<FType>::skippedRows() const {
+
+    return state ? state->skipped_rows : 0;
+}
+
+template <std::floating_point FType>
+std::size_t DelimitedRowStream<FType>::readRows(FType* buffer, const std::size_t max_rows) {
+
+    if (!good())
+    {
+        return 0;
+    }
+
+    const DelimitedFormat<FType>& format = state->format;
+    std::size_t rows = 0;
+
+    while (rows < max_rows)
+    {
+        const char* data = state->buffer.data();
+        const char* line_begin = data + state->begin;
+        const char* end = data + state->filled;
+        const char* newline = static_cast<const char*>(std::memchr(line_begin, '\n', end - line_begin));
+
+        if (newline == nullptr && !state->end_of_file)
+        {
+            state->refill();
+            continue;
+        }
+
+        if (newline == nullptr && line_begin == end)
+        {
+            break;
+        }
+
+        const char* line_end = newline == nullptr ? end : newline;
+        state->begin = newline == nullptr ? state->filled : newline + 1 - data;
+
+        if (line_end > line_begin && line_end[-1] == '\r')
+        {
+            --line_end;
+        }
+
+        const char* line = skipSpaces(line_begin, line_end);
+
+        if (line == line_end || *line == '%')
+        {
+            continue;
+        }
+
+        FType* row_ptr = buffer + rows * format.stride;
+        double label = 0;
+        std::fill(row_ptr + format.cols, row_ptr + format.stride, 0);
+
+        if (parseFields(format, line, line_end, row_ptr, label))
+        {
+            rows += 1;
+        }
+        else
+        {
+            state->skipped_rows += 1;
+        }
+    }
+
+    return rows;
+}
+
+template class DelimitedRowStream<float>;
+template class DelimitedRowStream<double>;
@@ -0,0 +1,527 @@
+#include <Dataset_Cache.h>
+#include <Data_Loader.h>
+#include <Dataset.h>
+#include <Aligned_Allocator.h>
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <zlib.h>
+#include <sys/mman.h>
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'K', 'M', 'C', 'A', 'C', 'H', 'E', '\0'};
+constexpr std::uint32_t CACHE_VERSION = 2;
+constexpr std::uint32_t CACHE_FLAG_LABELS = 1;
+constexpr std::uint32_t CACHE_FLAG_COMPRESSED = 2;
+constexpr std::uint32_t CACHE_FLAG_STATISTICS = 4;
+
+// the header is padded to this size, the values start right after it
+constexpr std::size_t CACHE_HEADER_BYTES = 128;
+constexpr std::size_t CACHE_DATA_ALIGNMENT = 64;
+
+// uncompressed size of a compressed block and of the blocks hashed in parallel for the checksum
+constexpr std::size_t CACHE_BLOCK_BYTES = std::size_t(1) << 22;
+
+// all values are stored in the byte order of the machine that wrote the cache
+struct CacheHeader {
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t item_size;
+    std::uint64_t rows;
+    std::uint64_t cols;
+    std::uint64_t stride;
+    std::uint32_t flags;
+    std::uint32_t alignment;
+    std::uint64_t n_blocks;
+    std::uint64_t data_offset;
+    std::uint64_t data_bytes;
+    std::uint64_t labels_offset;
+    std::uint64_t checksum;
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+
+    // hash of the path, size and modification time of the labels file, 0 if the cache was written without one
+    std::uint64_t labels_source;
+
+    // feature statistics collected by the loader: the row count and then mean, m2, min and max as cols doubles each
+    std::uint64_t statistics_offset;
+
+    // LabelColumn the delimited source was parsed with, None for all other sources
+    std::uint32_t label_column;
+
+};
+
+static_assert(sizeof(CacheHeader) <= CACHE_HEADER_BYTES);
+
+// offset and size of a compressed block, the table of all blocks is stored at data_offset
+struct CacheBlock {
+
+    std::uint64_t offset;
+    std::uint64_t size;
+
+};
+
+constexpr std::uint64_t HASH_PRIME = 0x100000001b3;
+constexpr std::uint64_t HASH_OFFSET = 0xcbf29ce484222325;
+
+// FNV style hash over 8 byte words of fixed size blocks that are hashed in parallel and combined in order,
+// so the checksum does not depend on the number of threads
+std::uint64_t checksumBytes(const char* bytes, const std::size_t size) {
+
+    const std::size_t n_blocks = (size + CACHE_BLOCK_BYTES - 1) / CACHE_BLOCK_BYTES;
+    std::vector<std::uint64_t> block_hashes(n_blocks);
+
+    #pragma omp parallel for default(none) shared(bytes, size, n_blocks, block_hashes, CACHE_BLOCK_BYTES) schedule(static)
+    for (std::size_t block = 0; block < n_blocks; ++block)
+    {
+        const char* begin = bytes + block * CACHE_BLOCK_BYTES;
+        const std::size_t block_size = std::min(CACHE_BLOCK_BYTES, size - block * CACHE_BLOCK_BYTES);
+
+        std::uint64_t hash = HASH_OFFSET ^ block;
+        std::size_t idx = 0;
+
+        for (; idx + sizeof(std::uint64_t) <= block_size; idx += sizeof(std::uint64_t))
+        {
+            std::uint64_t word;
+            std::memcpy(&word, begin + idx, sizeof(word));
+            hash = (hash ^ word) * HASH_PRIME;
+        }
+
+        for (; idx < block_size; ++idx)
+        {
+            hash = (hash ^ static_cast<unsigned char>(begin[idx])) * HASH_PRIME;
+        }
+
+        block_hashes[block] = hash;
+    }
+
+    std::uint64_t hash = HASH_OFFSET;
+    for (std::size_t block = 0; block < n_blocks; ++block)
+    {
+        hash = (hash ^ block_hashes[block]) * HASH_PRIME;
+    }
+
+    return hash;
+}
+
+std::uint64_t checksumDataset(const char* values, const std::size_t values_bytes, const int* labels, const std::size_t n_labels) {
+
+    std::uint64_t hash = checksumBytes(values, values_bytes);
+    return (hash ^ checksumBytes(reinterpret_cast<const char*>(labels), n_labels * sizeof(int))) * HASH_PRIME;
+}
+
+// size and modification time of the source, a cache written for another version of the file is stale
+void sourceStamp(const std::string& source_filename, std::uint64_t& size, std::int64_t& mtime) {
+
+    std::error_code error;
+    size = std::filesystem::file_size(source_filename, error);
+    mtime = error ? 0 : std::filesystem::last_write_time(source_filename, error).time_since_epoch().count();
+
+    if (error)
+    {
+        size = 0;
+        mtime = 0;
+    }
+}
+
+std::uint64_t labelsStamp(const std::string& labels_filename) {
+
+    if (labels_filename.empty())
+    {
+        return 0;
+    }
+
+    std::uint64_t size;
+    std::int64_t mtime;
+    sourceStamp(labels_filename, size, mtime);
+
+    std::uint64_t hash = HASH_OFFSET;
+
+    for (const char character : labels_filename)
+    {
+        hash = (hash ^ static_cast<unsigned char>(character)) * HASH_PRIME;
+    }
+
+    hash = (hash ^ size) * HASH_PRIME;
+    hash = (hash ^ static_cast<std::uint64_t>(mtime)) * HASH_PRIME;
+
+    // 0 is reserved for caches without a labels file
+    return hash != 0 ? hash : 1;
+}
+
+void writePadding(std::ofstream& file, const std::size_t alignment) {
+
+    const std::size_t position = file.tellp();
+    const std::vector<char> zeros(paddedSize(position, alignment) - position, 0);
+    file.write(zeros.data(), zeros.size());
+}
+
+}
+
+template <std::floating_point FType>
+bool writeDatasetCache(const std::string& filename, const Dataset<FType>& dataset, const bool compress, const std::string& source_filename, const std::string& labels_filename, const LabelColumn label_column) {
+
+    const char* values = reinterpret_cast<const char*>(dataset.data());
+    const std::size_t values_bytes = dataset.rows * dataset.stride * sizeof(FType);
+    const bool has_labels = dataset.labels.size() == dataset.rows && dataset.rows > 0;
+    const bool has_statistics = dataset.statistics.count == dataset.rows && dataset.statistics.cols() == dataset.cols && dataset.rows > 0;
+
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.item_size = sizeof(FType);
+    header.rows = dataset.rows;
+    header.cols = dataset.cols;
+    header.stride = dataset.stride;
+    header.flags = (has_labels ? CACHE_FLAG_LABELS : 0) | (compress ? CACHE_FLAG_COMPRESSED : 0) | (has_statistics ? CACHE_FLAG_STATISTICS : 0);
+    header.alignment = BYTE_ALIGNMENT;
+    header.data_offset = CACHE_HEADER_BYTES;
+    header.checksum = checksumDataset(values, values_bytes, dataset.labels.data(), has_labels ? dataset.rows : 0);
+
+    if (!source_filename.empty())
+    {
+        sourceStamp(source_filename, header.source_size, header.source_mtime);
+    }
+
+    header.labels_source = labelsStamp(labels_filename);
+    header.label_column = static_cast<std::uint32_t>(label_column);
+
+    // the blocks are compressed in parallel and written in order after the block table
+    std::vector<std::vector<unsigned char>> compressed_blocks;
+    std::vector<CacheBlock> block_table;
+
+    if (compress)
+    {
+        header.n_blocks = (values_bytes + CACHE_BLOCK_BYTES - 1) / CACHE_BLOCK_BYTES;
+        compressed_blocks.resize(header.n_blocks);
+        block_table.resize(header.n_blocks);
+        bool compressed = true;
+
+        #pragma omp parallel for default(none) shared(values, values_bytes, header, compressed_blocks, compressed, CACHE_BLOCK_BYTES) schedule(dynamic, 1)
+        for (std::size_t block = 0; block < header.n_blocks; ++block)
+        {
+            const std::size_t block_size = std::min(CACHE_BLOCK_BYTES, values_bytes - block * CACHE_BLOCK_BYTES);
+            uLongf compressed_size = compressBound(block_size);
+            compressed_blocks[block].resize(compressed_size);
+
+            if (compress2(compressed_blocks[block].data(), &compressed_size, reinterpret_cast<const Bytef*>(values + block * CACHE_BLOCK_BYTES), block_size, Z_BEST_SPEED) != Z_OK)
+            {
+                compressed = false;
+            }
+
+            compressed_blocks[block].resize(compressed_size);
+        }
+
+        if (!compressed)
+        {
+            std::cerr << "Error: Failed to compress the data set cache" << std::endl;
+            return false;
+        }
+
+        std::uint64_t offset = header.data_offset + header.n_blocks * sizeof(CacheBlock);
+        for (std::size_t block = 0; block < header.n_blocks; ++block)
+        {
+            block_table[block] = CacheBlock{offset, compressed_blocks[block].size()};
+            offset += compressed_blocks[block].size();
+        }
+
+        header.data_bytes = offset - header.data_offset;
+    }
+    else
+    {
+        header.data_bytes = values_bytes;
+    }
+
+    header.labels_offset = has_labels ? paddedSize(header.data_offset + header.data_bytes, CACHE_DATA_ALIGNMENT) : 0;
+    header.statistics_offset = has_statistics ? paddedSize(has_labels ? header.labels_offset + dataset.rows * sizeof(int) : header.data_offset + header.data_bytes, CACHE_DATA_ALIGNMENT) : 0;
+
+    // written to a temporary file first so that a concurrent run never maps a partially written cache
+    const std::string temporary_filename = filename + ".tmp";
+    std::ofstream file(temporary_filename, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Cannot write the data set cache " << filename << std::endl;
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(file, CACHE_HEADER_BYTES);
+
+    if (compress)
+    {
+        file.write(reinterpret_cast<const char*>(block_table.data()), block_table.size() * sizeof(CacheBlock));
+        for (const auto& block : compressed_blocks)
+        {
+            file.write(reinterpret_cast<const char*>(block.data()), block.size());
+        }
+    }
+    else
+    {
+        file.write(values, values_bytes);
+    }
+
+    if (has_labels)
+    {
+        writePadding(file, CACHE_DATA_ALIGNMENT);
+        file.write(reinterpret_cast<const char*>(dataset.labels.data()), dataset.rows * sizeof(int));
+    }
+
+    if (has_statistics)
+    {
+        const std::uint64_t count = dataset.statistics.count;
+        writePadding(file, CACHE_DATA_ALIGNMENT);
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+        for (const std::vector<double>* statistic : {&dataset.statistics.mean, &dataset.statistics.m2, &dataset.statistics.min, &dataset.statistics.max})
+        {
+            file.write(reinterpret_cast<const char*>(statistic->data()), dataset.cols * sizeof(double));
+        }
+    }
+
+    file.close();
+
+    std::error_code error;
+    if (!file || (std::filesystem::rename(temporary_filename, filename, error), error))
+    {
+        std::cerr << "Error: Cannot write the data set cache " << filename << std::endl;
+        std::filesystem::remove(temporary_filename, error);
+        return false;
+    }
+
+    std::cout << "Wrote data set cache " << filename << std::endl;
+    return true;
+}
+
+template <std::floating_point FType>
+bool readDatasetCache(const std::string& filename, Dataset<FType>& dataset, const std::string& source_filename, const bool verify_checksum, const std::string& labels_filename, const LabelColumn label_column) {
+
+    std::size_t file_size;
+    std::shared_ptr<void> storage = mapFile(filename, file_size);
+
+    if (!storage)
+    {
+        return false;
+    }
+
+    const char* file = static_cast<const char*>(storage.get());
+
+    CacheHeader header;
+    if (file_size < CACHE_HEADER_BYTES || std::memcmp(file, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+    {
+        std::cerr << "Error: " << filename << " is not a data set cache" << std::endl;
+        return false;
+    }
+
+    std::memcpy(&header, file, sizeof(header));
+
+    if (header.version != CACHE_VERSION)
+    {
+        std::cerr << "Error: " << filename << " has cache version " << header.version << ", expected " << CACHE_VERSION << std::endl;
+        return false;
+    }
+
+    if (header.item_size != sizeof(FType) || header.stride != alignedRowSize<FType>(header.cols))
+    {
+        std::cerr << "Error: " << filename << " was written for another data type or BYTE_ALIGNMENT" << std::endl;
+        return false;
+    }
+
+    const bool has_labels = header.flags & CACHE_FLAG_LABELS;
+    const bool compressed = header.flags & CACHE_FLAG_COMPRESSED;
+    const bool has_statistics = header.flags & CACHE_FLAG_STATISTICS;
+    const std::size_t values_bytes = header.rows * header.stride * sizeof(FType);
+    const std::size_t statistics_bytes = sizeof(std::uint64_t) + 4 * header.cols * sizeof(double);
+
+    if (header.data_offset + header.data_bytes > file_size || (has_labels && header.labels_offset + header.rows * sizeof(int) > file_size)
+        || (has_statistics && header.statistics_offset + statistics_bytes > file_size)
+        || (!compressed && header.data_bytes != values_bytes) || (compressed && header.n_blocks * sizeof(CacheBlock) > header.data_bytes))
+    {
+        std::cerr << "Error: " << filename << " is truncated" << std::endl;
+        return false;
+    }
+
+    if (!source_filename.empty())
+    {
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        sourceStamp(source_filename, source_size, source_mtime);
+
+        if (source_size != header.source_size || source_mtime != header.source_mtime)
+        {
+            std::cout << "Data set cache " << filename << " is out of date" << std::endl;
+            return false;
+        }
+
+        // a cache written without labels (or with another labels file) must not hide the labels that were asked for
+        if (labelsStamp(labels_filename) != header.labels_source)
+        {
+            std::cout << "Data set cache " << filename << " was written with other labels" << std::endl;
+            return false;
+        }
+
+        // the same CSV parsed with another label column has another number of features
+        if (header.label_column != static_cast<std::uint32_t>(label_column))
+        {
+            std::cout << "Data set cache " << filename << " was written with another label column" << std::endl;
+            return false;
+        }
+    }
+
+    dataset = Dataset<FType>{};
+    dataset.rows = header.rows;
+    dataset.cols = header.cols;
+    dataset.stride = header.stride;
+
+    if (compressed)
+    {
+        // every block decompresses into its own part of the buffer so the blocks are independent
+        const CacheBlock* block_table = reinterpret_cast<const CacheBlock*>(file + header.data_offset);
+        dataset.values.resize(header.rows * header.stride);
+        char* values = reinterpret_cast<char*>(dataset.values.data());
+        bool decompressed = true;
+
+        #pragma omp parallel for default(none) shared(file, file_size, header, block_table, values, values_bytes, decompressed, CACHE_BLOCK_BYTES) schedule(dynamic, 1)
+        for (std::size_t block = 0; block < header.n_blocks; ++block)
+        {
+            const std::size_t block_size = std::min(CACHE_BLOCK_BYTES, values_bytes - block * CACHE_BLOCK_BYTES);
+            uLongf uncompressed_size = block_size;
+
+            if (block_table[block].offset + block_table[block].size > file_size
+                || uncompress(reinterpret_cast<Bytef*>(values + block * CACHE_BLOCK_BYTES), &uncompressed_size,
+                              reinterpret_cast<const Bytef*>(file + block_table[block].offset), block_table[block].size) != Z_OK
+                || uncompressed_size != block_size)
+            {
+                decompressed = false;
+            }
+        }
+
+        if (!decompressed)
+        {
+            std::cerr << "Error: " << filename << " holds a corrupt compressed block" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        // the mapping is page aligned and the values start at a 64 byte offset, so the rows can be used in place
+        madvise(storage.get(), file_size, MADV_WILLNEED);
+        dataset.view = reinterpret_cast<FType*>(const_cast<char*>(file + header.data_offset));
+        dataset.storage = std::move(storage);
+    }
+
+    if (has_labels)
+    {
+        const int* labels = reinterpret_cast<const int*>(file + header.labels_offset);
+        dataset.labels.assign(labels, labels + header.rows);
+    }
+
+    // with the stored statistics scaling the data set only needs the pass that applies it
+    if (has_statistics)
+    {
+        const char* statistics = file + header.statistics_offset;
+        std::uint64_t count;
+        std::memcpy(&count, statistics, sizeof(count));
+        dataset.statistics.count = count;
+        statistics += sizeof(count);
+
+        for (std::vector<double>* statistic : {&dataset.statistics.mean, &dataset.statistics.m2, &dataset.statistics.min, &dataset.statistics.max})
+        {
+            statistic->resize(header.cols);
+            std::memcpy(statistic->data(), statistics, header.cols * sizeof(double));
+            statistics += header.cols * sizeof(double);
+        }
+    }
+
+    if (verify_checksum && checksumDataset(reinterpret_cast<const char*>(dataset.data()), values_bytes, dataset.labels.data(), dataset.labels.size()) != header.checksum)
+    {
+        std::cerr << "Error: Checksum of " << filename << " does not match" << std::endl;
+        dataset = Dataset<FType>{};
+        return false;
+    }
+
+    std::cout << "Loaded data set cache " << filename << std::endl;
+    std::cout << "Rows: " << dataset.rows << " Columns: " << dataset.cols << " Labels: " << dataset.labels.size() << std::endl;
+
+    return true;
+}
+
+bool readDatasetCacheLayout(const std::string& filename, BinaryLayout& layout) {
+
+    std::ifstream file(filename, std::ios::binary);
+    CacheHeader header;
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+    {
+        std::cerr << "Error: " << filename << " is not a data set cache" << std::endl;
+        return false;
+    }
+
+    if (header.version != CACHE_VERSION || (header.flags & CACHE_FLAG_COMPRESSED))
+    {
+        std::cerr << "Error: " << filename << " is compressed or has another cache version" << std::endl;
+        return false;
+    }
+
+    layout.item_size = header.item_size;
+    layout.rows = header.rows;
+    layout.cols = header.cols;
+    layout.stride = header.stride;
+    layout.data_offset = header.data_offset;
+
+    return true;
+}
+
+template <std::floating_point FType>
+bool readDatasetCached(const std::string& filename, Dataset<FType>& dataset, const DataFormat format, const std::string& labels_filename, const bool compress_cache, const LabelColumn label_column, const bool collect_statistics, const bool verify_checksum) {
+
+    const DataFormat file_format = format == DataFormat::Auto ? detectDataFormat(filename) : format;
+
+    // only delimited files have a label column, the caches of all other sources record None
+    const LabelColumn source_label_column = file_format == DataFormat::Delimited ? label_column : LabelColumn::None;
+
+    // .npy files are already mapped without parsing and caches are read directly
+    if (file_format == DataFormat::Npy)
+    {
+        return readDataset(filename, dataset, file_format, labels_filename);
+    }
+
+    if (file_format == DataFormat::Cache)
+    {
+        return readDatasetCache(filename, dataset, "", verify_checksum);
+    }
+
+    const std::string cache_filename = filename + std::string(DATASET_CACHE_EXTENSION);
+
+    if (std::filesystem::exists(cache_filename) && readDatasetCache(cache_filename, dataset, filename, verify_checksum, labels_filename, source_label_column))
+    {
+        return true;
+    }
+
+    if (!readDataset(filename, dataset, file_format, labels_filename, label_column, collect_statistics))
+    {
+        return false;
+    }
+
+    // a cache that can not be written (e.g. read only directory) only costs the parsing on the next run
+    writeDatasetCache(cache_filename, dataset, compress_cache, filename, labels_filename, source_label_column);
+
+    return true;
+}
+
+template bool writeDatasetCache<float>(const std::string& filename, const Dataset<float>& dataset, const bool compress, const std::string& source_filename, const std::string& labels_filename, const LabelColumn label_column);
+template bool writeDatasetCache<double>(const std::string& filename, const Dataset<double>& dataset, const bool compress, const std::string& source_filename, const std::string& labels_filename, const LabelColumn label_column);
+
+template bool readDatasetCache<float>(const std::string& filename, Dataset<float>& dataset, const std::string& source_filename, const bool verify_checksum, const std::string& labels_filename, const LabelColumn label_column);
+template bool readDatasetCache<double>(const std::string& filename, Dataset<double>& dataset, const std::string& source_filename, const bool verify_checksum, const std::string& labels_filename, const LabelColumn label_column);
+
+template bool readDatasetCached<float>(const std::string& filename, Dataset<float>& dataset, const DataFormat format, const std::string& labels_filename, const bool compress_cache, const LabelColumn label_column, const bool collect_statistics, const bool verify_checksum);
+template bool readDatasetCached<double>(const std::string& filename, Dataset<double>& dataset, const DataFormat format, const std::string& labels_filename, const bool compress_cache, const LabelColumn label_column, const bool collect_statistics, const bool verify_checksum);
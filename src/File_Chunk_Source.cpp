@@ -0,0 +1,205 @@
+#include <File_Chunk_Source.h>
+#include <Data_Loader.h>
+#include <Dataset_Cache.h>
+#include <Aligned_Allocator.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+template <std::floating_point FType>
+FileChunkSource<FType>::~FileChunkSource() {
+
+    if (file_descriptor >= 0)
+    {
+        close(file_descriptor);
+    }
+}
+
+template <std::floating_point FType>
+bool FileChunkSource<FType>::open(const std::string& filename, const DataFormat format) {
+
+    const DataFormat file_format = format == DataFormat::Auto ? detectDataFormat(filename) : format;
+    bool has_layout = false;
+
+    if (file_format == DataFormat::Npy)
+    {
+        has_layout = readNpyLayout(filename, layout);
+    }
+    else if (file_format == DataFormat::Cache)
+    {
+        has_layout = readDatasetCacheLayout(filename, layout);
+    }
+    else
+    {
+        std::cerr << "Error: Only .npy and uncompressed " << DATASET_CACHE_EXTENSION << " files can be streamed" << std::endl;
+    }
+
+    if (!has_layout || (layout.item_size != sizeof(float) && layout.item_size != sizeof(double)))
+    {
+        return false;
+    }
+
+    if (file_descriptor >= 0)
+    {
+        close(file_descriptor);
+    }
+
+    file_descriptor = ::open(filename.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+    {
+        std::cerr << "Error: Cannot open file " << filename << std::endl;
+        return false;
+    }
+
+    // every iteration reads the file from the front to the back
+    posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    return true;
+}
+
+template <std::floating_point FType>
+bool FileChunkSource<FType>::readBytes(char* buffer, std::size_t size, std::size_t offset) const {
+
+    while (size > 0)
+    {
+        ssize_t bytes = pread(file_descriptor, buffer, size, offset);
+
+        if (bytes <= 0)
+        {
+            return false;
+        }
+
+        buffer += bytes;
+        size -= bytes;
+        offset += bytes;
+    }
+
+    return true;
+}
+
+template <std::floating_point FType>
+bool FileChunkSource<FType>::readRows(const std::size_t first_row, const std::size_t n_rows, FType* buffer) const {
+
+    if (file_descriptor < 0 || first_row + n_rows > layout.rows)
+    {
+        return false;
+    }
+
+    const std::size_t stride = alignedRowSize<FType>(layout.cols);
+    const std::size_t file_row_bytes = layout.stride * layout.item_size;
+    const std::size_t offset = layout.data_offset + first_row * file_row_bytes;
+
+    // the file already has the padded layout of the engine
+    if (layout.item_size == sizeof(FType) && layout.stride == stride)
+    {
+        return readBytes(reinterpret_cast<char*>(buffer), n_rows * file_row_bytes, offset);
+    }
+
+    staging.resize(n_rows * file_row_bytes);
+
+    if (!readBytes(staging.data(), staging.size(), offset))
+    {
+        return false;
+    }
+
+    for (std::size_t row = 0; row < n_rows; ++row)
+    {
+        FType* row_ptr = buffer + row * stride;
+        const char* file_row = staging.data() + row * file_row_bytes;
+
+        if (layout.item_size == sizeof(float))
+        {
+            const float* values = reinterpret_cast<const float*>(file_row);
+            std::copy(values, values + layout.cols, row_ptr);
+        }
+        else
+        {
+            const double* values = reinterpret_cast<const double*>(file_row);
+            std::copy(values, values + layout.cols, row_ptr);
+        }
+
+        std::fill(row_ptr + layout.cols, row_ptr + stride, 0);
+    }
+
+    return true;
+}
+
+template class FileChunkSource<float>;
+template class FileChunkSource<double>;
+
+namespace {
+
+// reads the rows of a binary file from the front to the back
+template <std::floating_point FType>
+class FileRowStream : public RowStream<FType> {
+
+public:
+
+    FileChunkSource<FType> source;
+    std::size_t next_row = 0;
+    bool failed = false;
+
+    std::size_t cols() const override { return source.cols(); }
+    bool good() const override { return !failed; }
+
+    std::size_t readRows(FType* buffer, const std::size_t max_rows) override {
+
+        const std::size_t n_rows = std::min(max_rows, source.rows() - next_row);
+
+        if (n_rows == 0 || failed)
+        {
+            return 0;
+        }
+
+        if (!source.readRows(next_row, n_rows, buffer))
+        {
+            std::cerr << "Error: Failed to read rows " << next_row << " to " << next_row + n_rows << std::endl;
+            failed = true;
+            return 0;
+        }
+
+        next_row += n_rows;
+        return n_rows;
+    }
+
+};
+
+}
+
+template <std::floating_point FType>
+std::unique_ptr<RowStream<FType>> openRowStream(const std::string& filename, const DataFormat format, const LabelColumn label_column) {
+
+    const DataFormat file_format = format == DataFormat::Auto ? detectDataFormat(filename) : format;
+
+    if (file_format == DataFormat::Npy || file_format == DataFormat::Cache)
+    {
+        auto stream = std::make_unique<FileRowStream<FType>>();
+        if (!stream->source.open(filename, file_format))
+        {
+            return nullptr;
+        }
+
+        return stream;
+    }
+
+    if (file_format == DataFormat::Delimited)
+    {
+        auto stream = std::make_unique<DelimitedRowStream<FType>>();
+        if (!stream->open(filename, label_column))
+        {
+            return nullptr;
+        }
+
+        return stream;
+    }
+
+    std::cerr << "Error: " << filename << " can not be streamed, use ARFF/CSV, .npy or an uncompressed " << DATASET_CACHE_EXTENSION << std::endl;
+    return nullptr;
+}
+
+template std::unique_ptr<RowStream<float>> openRowStream<float>(const std::string& filename, const DataFormat format, const LabelColumn label_column);
+template std::unique_ptr<RowStream<double>> openRowStream<double>(const std::string& filename, const DataFormat format, const LabelColumn label_column);
@@ -0,0 +1,278 @@
+#include <Preprocessing.h>
+#include <Feature_Statistics.h>
+#include <Dataset.h>
+#include <Aligned_Allocator.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+namespace {
+
+// rows of a block in FeatureStatistics::accumulate, the block is read twice (mean, then m2)
+// and is small enough to still be in the L1/L2 cache for the second read
+constexpr std::size_t STATISTICS_BLOCK_ROWS = 32;
+
+}
+
+std::vector<double> FeatureStatistics::variance() const {
+
+    std::vector<double> result(cols(), 0);
+
+    if (count > 0)
+    {
+        for (std::size_t col = 0; col < cols(); ++col)
+        {
+            result[col] = m2[col] / count;
+        }
+    }
+
+    return result;
+}
+
+template <std::floating_point FType>
+void FeatureStatistics::accumulate(const FType* data, const std::size_t rows, const std::size_t n_cols, const std::size_t stride) {
+
+    FeatureStatistics block;
+    block.mean.resize(n_cols);
+    block.m2.resize(n_cols);
+    block.min.resize(n_cols);
+    block.max.resize(n_cols);
+
+    double* block_mean = block.mean.data();
+    double* block_m2 = block.m2.data();
+    double* block_min = block.min.data();
+    double* block_max = block.max.data();
+
+    for (std::size_t first_row = 0; first_row < rows; first_row += STATISTICS_BLOCK_ROWS)
+    {
+        const std::size_t block_rows = std::min(STATISTICS_BLOCK_ROWS, rows - first_row);
+        const FType* block_data = data + first_row * stride;
+
+        std::copy(block_data, block_data + n_cols, block_mean);
+        std::copy(block_data, block_data + n_cols, block_min);
+        std::copy(block_data, block_data + n_cols, block_max);
+
+        for (std::size_t row = 1; row < block_rows; ++row)
+        {
+            const FType* row_ptr = block_data + row * stride;
+
+            #pragma omp simd
+            for (std::size_t col = 0; col < n_cols; ++col)
+            {
+                block_mean[col] += row_ptr[col];
+                block_min[col] = std::min<double>(block_min[col], row_ptr[col]);
+                block_max[col] = std::max<double>(block_max[col], row_ptr[col]);
+            }
+        }
+
+        const double inverse_rows = 1.0 / block_rows;
+
+        #pragma omp simd
+        for (std::size_t col = 0; col < n_cols; ++col)
+        {
+            block_mean[col] *= inverse_rows;
+            block_m2[col] = 0;
+        }
+
+        // deviations from the block mean instead of sums of squares, which cancel badly for features far from 0
+        for (std::size_t row = 0; row < block_rows; ++row)
+        {
+            const FType* row_ptr = block_data + row * stride;
+
+            #pragma omp simd
+            for (std::size_t col = 0; col < n_cols; ++col)
+            {
+                const double deviation = row_ptr[col] - block_mean[col];
+                block_m2[col] += deviation * deviation;
+            }
+        }
+
+        block.count = block_rows;
+        merge(block);
+    }
+}
+
+void FeatureStatistics::merge(const FeatureStatistics& other) {
+
+    if (other.count == 0)
+    {
+        return;
+    }
+
+    if (count == 0)
+    {
+        *this = other;
+        return;
+    }
+
+    const double total = count + other.count;
+    const double other_weight = other.count / total;
+    const double m2_weight = static_cast<double>(count) * other.count / total;
+
+    #pragma omp simd
+    for (std::size_t col = 0; col < cols(); ++col)
+    {
+        const double delta = other.mean[col] - mean[col];
+        mean[col] += delta * other_weight;
+        m2[col] += other.m2[col] + delta * delta * m2_weight;
+        min[col] = std::min(min[col], other.min[col]);
+        max[col] = std::max(max[col], other.max[col]);
+    }
+
+    count += other.count;
+}
+
+template <std::floating_point FType>
+FeatureStatistics computeFeatureStatistics(const FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride) {
+
+    std::vector<FeatureStatistics> partial_statistics(omp_get_max_threads());
+
+    #pragma omp parallel default(none) shared(data, rows, cols, stride, partial_statistics)
+    {
+        const std::size_t thread = omp_get_thread_num();
+        const std::size_t n_threads = omp_get_num_threads();
+        const std::size_t first_row = rows * thread / n_threads;
+        const std::size_t last_row = rows * (thread + 1) / n_threads;
+
+        partial_statistics[thread].accumulate(data + first_row * stride, last_row - first_row, cols, stride);
+    }
+
+    FeatureStatistics statistics;
+
+    for (const FeatureStatistics& partial : partial_statistics)
+    {
+        statistics.merge(partial);
+    }
+
+    return statistics;
+}
+
+template <std::floating_point FType>
+void applyScaling(FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, const Scaling scaling, const FeatureStatistics& statistics) {
+
+    if (scaling == Scaling::None)
+    {
+        return;
+    }
+
+    if (scaling == Scaling::L2)
+    {
+        #pragma omp parallel for default(none) shared(data, rows, cols, stride) schedule(static)
+        for (std::size_t row = 0; row < rows; ++row)
+        {
+            FType* row_ptr = data + row * stride;
+            FType squared_norm = 0;
+
+            #pragma omp simd reduction(+:squared_norm)
+            for (std::size_t col = 0; col < cols; ++col)
+            {
+                squared_norm += row_ptr[col] * row_ptr[col];
+            }
+
+            if (squared_norm > 0)
+            {
+                const FType inverse_norm = 1 / std::sqrt(squared_norm);
+
+                #pragma omp simd
+                for (std::size_t col = 0; col < cols; ++col)
+                {
+                    row_ptr[col] *= inverse_norm;
+                }
+            }
+        }
+
+        return;
+    }
+
+    // both per feature scalings are x' = (x - shift) * scale
+    std::vector<FType, AlignedAllocator<FType>> shift(cols);
+    std::vector<FType, AlignedAllocator<FType>> scale(cols);
+    const std::vector<double> variance = statistics.variance();
+
+    for (std::size_t col = 0; col < cols; ++col)
+    {
+        if (scaling == Scaling::Standardize)
+        {
+            shift[col] = statistics.mean[col];
+            scale[col] = variance[col] > 0 ? 1 / std::sqrt(variance[col]) : 0;
+        }
+        else
+        {
+            shift[col] = statistics.min[col];
+            scale[col] = statistics.max[col] > statistics.min[col] ? 1 / (statistics.max[col] - statistics.min[col]) : 0;
+        }
+    }
+
+    const FType* shift_ptr = shift.data();
+    const FType* scale_ptr = scale.data();
+
+    #pragma omp parallel for default(none) shared(data, rows, cols, stride, shift_ptr, scale_ptr) schedule(static)
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        FType* row_ptr = data + row * stride;
+
+        #pragma omp simd
+        for (std::size_t col = 0; col < cols; ++col)
+        {
+            row_ptr[col] = (row_ptr[col] - shift_ptr[col]) * scale_ptr[col];
+        }
+    }
+}
+
+template <std::floating_point FType>
+bool scaleDataset(Dataset<FType>& dataset, const Scaling scaling) {
+
+    if (scaling == Scaling::None)
+    {
+        return true;
+    }
+
+    if (dataset.rows == 0 || dataset.cols == 0)
+    {
+        std::cerr << "Error: Cannot scale an empty data set" << std::endl;
+        return false;
+    }
+
+    // the loaders of delimited files and the binary cache provide the statistics without another pass
+    if (needsStatistics(scaling) && (dataset.statistics.count != dataset.rows || dataset.statistics.cols() != dataset.cols))
+    {
+        dataset.statistics = computeFeatureStatistics(dataset.data(), dataset.rows, dataset.cols, dataset.stride);
+    }
+
+    applyScaling(dataset.data(), dataset.rows, dataset.cols, dataset.stride, scaling, dataset.statistics);
+
+    std::cout << "Scaled " << dataset.rows << " rows of " << dataset.cols << " features" << std::endl;
+    return true;
+}
+
+bool needsStatistics(const Scaling scaling) {
+
+    return scaling == Scaling::Standardize || scaling == Scaling::MinMax;
+}
+
+bool parseScaling(const std::string& name, Scaling& scaling) {
+
+    if (name == "none") scaling = Scaling::None;
+    else if (name == "standard") scaling = Scaling::Standardize;
+    else if (name == "minmax") scaling = Scaling::MinMax;
+    else if (name == "l2") scaling = Scaling::L2;
+    else return false;
+
+    return true;
+}
+
+template void FeatureStatistics::accumulate<float>(const float* data, const std::size_t rows, const std::size_t n_cols, const std::size_t stride);
+template void FeatureStatistics::accumulate<double>(const double* data, const std::size_t rows, const std::size_t n_cols, const std::size_t stride);
+
+template FeatureStatistics computeFeatureStatistics<float>(const float* data, const std::size_t rows, const std::size_t cols, const std::size_t stride);
+template FeatureStatistics computeFeatureStatistics<double>(const double* data, const std::size_t rows, const std::size_t cols, const std::size_t stride);
+
+template void applyScaling<float>(float* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, const Scaling scaling, const FeatureStatistics& statistics);
+template void applyScaling<double>(double* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, const Scaling scaling, const FeatureStatistics& statistics);
+
+template bool scaleDataset<float>(Dataset<float>& dataset, const Scaling scaling);
+template bool scaleDataset<double>(Dataset<double>& dataset, const Scaling scaling);
@@ -70,7 +70,8 @@ def main():
     print("Fetching MNIST dataset if it is not already loaded")
     
     mnist = fetch_openml('mnist_784', data_home = custom_cache_dir)
-    data = mnist.data.to_numpy()
+    # float32 and C order so fit reads the array in place instead of converting it in every timing iteration
+    data = np.ascontiguousarray(mnist.data.to_numpy(), dtype = np.float32)
     
     print("Done")
     
@@ -0,0 +1,197 @@
+#include <Serving_Model.h>
+#include <Cont_Mem_Parallel_KMeans.h>
+#include <Aligned_Allocator.h>
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+// the serving model publishes the flat centroids of the contiguous memory implementation
+#ifdef USE_CONT_MEM
+
+namespace {
+
+// stripe of the reader counters used by the calling thread, fixed for the lifetime of the thread
+std::size_t readerStripe() {
+
+    static std::atomic<std::size_t> next_stripe{0};
+    thread_local const std::size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+
+    return stripe;
+}
+
+}
+
+template <std::floating_point FType>
+ServingModel<FType>::~ServingModel() {
+
+    // no reader may be left once the owner destroys the model
+    delete current.load();
+}
+
+template <std::floating_point FType>
+bool ServingModel<FType>::publish(const Parallel_KMeans<FType>& model) {
+
+    if (model.n_features == 0 || model.centroids.size() < static_cast<std::size_t>(model.n_cluster) * model.row_stride)
+    {
+        std::cerr << "Error: Cannot publish a model without centroids" << std::endl;
+        return false;
+    }
+
+    auto snapshot = new Snapshot;
+    snapshot->n_cluster = model.n_cluster;
+    snapshot->n_features = model.n_features;
+    snapshot->row_stride = model.row_stride;
+    snapshot->centroids.assign(model.centroids.begin(), model.centroids.begin() + model.n_cluster * model.row_stride);
+    snapshot->norms.resize(model.n_cluster);
+
+    for (int centroid = 0; centroid < snapshot->n_cluster; ++centroid)
+    {
+        const FType* centroid_ptr = &snapshot->centroids[centroid * snapshot->row_stride];
+        FType norm = 0;
+
+        #pragma omp simd reduction(+: norm)
+        for (std::size_t col = 0; col < snapshot->n_features; ++col)
+        {
+            norm += centroid_ptr[col] * centroid_ptr[col];
+        }
+
+        snapshot->norms[centroid] = norm;
+    }
+
+    std::lock_guard<std::mutex> lock(publish_mutex);
+
+    const Snapshot* previous = current.load();
+    snapshot->version = previous != nullptr ? previous->version + 1 : 1;
+
+    previous = current.exchange(snapshot);
+
+    // a reader that still holds the previous snapshot incremented its counter before the exchange, but possibly
+    // with an epoch read long before, so the counters of both parities are drained, each after the epoch moved
+    // away from it so new readers do not keep it busy
+    for (int flip = 0; flip < 2; ++flip)
+    {
+        const std::uint64_t old_epoch = epoch.fetch_add(1);
+        waitForReaders(old_epoch & 1);
+    }
+
+    delete previous;
+    return true;
+}
+
+template <std::floating_point FType>
+std::atomic<std::size_t>& ServingModel<FType>::readerCounter() const {
+
+    return readers[epoch.load() & 1][readerStripe() % READER_STRIPES].count;
+}
+
+template <std::floating_point FType>
+void ServingModel<FType>::waitForReaders(const std::size_t parity) const {
+
+    for (const ReaderCounter& counter : readers[parity])
+    {
+        while (counter.count.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+template <std::floating_point FType>
+bool ServingModel<FType>::predict(const FType* data, const std::size_t rows, const std::size_t cols, const std::size_t stride, int* labels, FType* distances) const {
+
+    // read section: the snapshot can not be freed until the counter is decremented again
+    std::atomic<std::size_t>& reader = readerCounter();
+    reader.fetch_add(1);
+
+    const Snapshot* snapshot = current.load();
+
+    if (snapshot == nullptr)
+    {
+        reader.fetch_sub(1, std::memory_order_release);
+        std::cerr << "Error: No centroids were published yet" << std::endl;
+        return false;
+    }
+
+    if (cols != snapshot->n_features || stride < cols)
+    {
+        reader.fetch_sub(1, std::memory_order_release);
+        std::cerr << "Data does not match the published centroids" << std::endl;
+        return false;
+    }
+
+    const int n_cluster = snapshot->n_cluster;
+    const std::size_t row_stride = snapshot->row_stride;
+    const FType* centroids = snapshot->centroids.data();
+    const FType* norms = snapshot->norms.data();
+
+    // |x - c|^2 = |x|^2 - 2 x.c + |c|^2, the nearest centroid only needs |c|^2 - 2 x.c
+    #pragma omp parallel for default(none) shared(data, rows, cols, stride, labels, distances, n_cluster, row_stride, centroids, norms) schedule(static) if(rows >= SERVING_PARALLEL_ROWS)
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        const FType* row_ptr = data + row * stride;
+        FType min_distance = std::numeric_limits<FType>::max();
+        int best_centroid = 0;
+
+        for (int centroid = 0; centroid < n_cluster; ++centroid)
+        {
+            const FType* centroid_ptr = centroids + centroid * row_stride;
+            FType dot = 0;
+
+            #pragma omp simd reduction(+: dot)
+            for (std::size_t col = 0; col < cols; ++col)
+            {
+                dot += row_ptr[col] * centroid_ptr[col];
+            }
+
+            const FType distance = norms[centroid] - 2 * dot;
+
+            if (distance < min_distance)
+            {
+                min_distance = distance;
+                best_centroid = centroid;
+            }
+        }
+
+        labels[row] = best_centroid;
+
+        if (distances != nullptr)
+        {
+            FType norm = 0;
+
+            #pragma omp simd reduction(+: norm)
+            for (std::size_t col = 0; col < cols; ++col)
+            {
+                norm += row_ptr[col] * row_ptr[col];
+            }
+
+            distances[row] = std::sqrt(std::max(norm + min_distance, FType(0)));
+        }
+    }
+
+    reader.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+template <std::floating_point FType>
+std::uint64_t ServingModel<FType>::version() const {
+
+    std::atomic<std::size_t>& reader = readerCounter();
+    reader.fetch_add(1);
+
+    const Snapshot* snapshot = current.load();
+    const std::uint64_t snapshot_version = snapshot != nullptr ? snapshot->version : 0;
+
+    reader.fetch_sub(1, std::memory_order_release);
+    return snapshot_version;
+}
+
+template class ServingModel<float>;
+template class ServingModel<double>;
+
+#endif
@@ -5,8 +5,21 @@
 #include <Parallel_KMeans.h>
 #endif
 #include <KMeans.h>
+#include <CSR_Matrix.h>
+#include <SIMD_Operations.h>
+#include <Data_Loader.h>
+#include <Dataset_Cache.h>
 #include <vector>
 #include <iostream>
+#include <string>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <omp.h>
 
 const double TOL = 1e-9;
 const int MAX_ITER = 500;
@@ -65,6 +78,431 @@ void CheckLabels(){
 
 }
 
+#ifdef USE_CONT_MEM
+namespace {
+
+// rows x cols values (no padding) around n_cluster random centers, the same for the same seed
+std::vector<double> ClusteredRows(const std::size_t rows, const std::size_t cols, const int n_cluster, const unsigned int seed) {
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> center_dist(-20.0, 20.0);
+    std::normal_distribution<double> noise(0.0, 1.0);
+
+    std::vector<double> centers(n_cluster * cols);
+    for (double& value : centers)
+    {
+        value = center_dist(gen);
+    }
+
+    std::vector<double> data(rows * cols);
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        const double* center = &centers[(row % n_cluster) * cols];
+
+        for (std::size_t col = 0; col < cols; ++col)
+        {
+            data[row * cols + col] = center[col] + noise(gen);
+        }
+    }
+
+    return data;
+}
+
+// writes rows x cols values as a version 1.0 .npy file of StoredType, returns false if the file can not be written
+template <typename StoredType>
+bool WriteNpy(const std::string& filename, const std::vector<double>& data, const std::size_t rows, const std::size_t cols) {
+
+    std::string header = "{'descr': '<f" + std::to_string(sizeof(StoredType)) + "', 'fortran_order': False, 'shape': ("
+                         + std::to_string(rows) + ", " + std::to_string(cols) + "), }";
+
+    // the header is padded with spaces and ends with a newline so the data starts at a multiple of 64 bytes
+    const std::size_t PREFIX_LENGTH = 10;
+    header.append(63 - (PREFIX_LENGTH + header.size()) % 64, ' ');
+    header.push_back('\n');
+
+    const std::uint16_t header_length = static_cast<std::uint16_t>(header.size());
+    const char prefix[PREFIX_LENGTH] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                        static_cast<char>(header_length & 0xff), static_cast<char>(header_length >> 8)};
+
+    std::vector<StoredType> values(data.begin(), data.end());
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(prefix, PREFIX_LENGTH);
+    file.write(header.data(), header.size());
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(StoredType));
+
+    return static_cast<bool>(file);
+}
+
+}
+
+bool CheckSparse(){
+
+    // mostly zero data so that the CSR path only has to touch a third of the values
+    std::vector<std::vector<float>> test_data =   {{1.2, 0.0, 0.0, 1.8},
+                                                    {0.0, 3.6, 0.0, 3.8},
+                                                    {1.3, 0.0, 0.0, 1.9},
+                                                    {0.0, 3.5, 0.0, 3.9},
+                                                    {0.0, 0.0, 10.4, 0.0},
+                                                    {0.0, 0.0, 10.9, 0.0}
+                                                    };
+
+    const int N_CLUSTER = 3;
+    const int SEED = 42;
+
+    Parallel_KMeans<float, std::size_t> dense_kmeans(N_CLUSTER, MAX_ITER, TOL, SEED);
+    Parallel_KMeans<float, std::size_t> sparse_kmeans(N_CLUSTER, MAX_ITER, TOL, SEED);
+
+    dense_kmeans.fit(test_data);
+    sparse_kmeans.fit(DenseToCSR<float, std::size_t>(test_data));
+
+    std::cout << "Dense Fit Labels / Sparse Fit Labels" << std::endl;
+
+    for (std::size_t i = 0; i < dense_kmeans.labels.size(); ++i)
+    {
+        std::cout << dense_kmeans.labels[i] << "/" << sparse_kmeans.labels[i] << " ";
+    }
+
+    std::cout << std::endl;
+    std::cout << "Dense Inertia: " << dense_kmeans.inertia << " Sparse Inertia: " << sparse_kmeans.inertia << std::endl;
+
+    // both paths start from the same rows of the same seed, only the summation order of the distances differs
+    const bool same_labels = dense_kmeans.labels == sparse_kmeans.labels;
+    const bool same_inertia = std::abs(dense_kmeans.inertia - sparse_kmeans.inertia) <= 1e-4 * std::max(1.0, std::abs(dense_kmeans.inertia));
+
+    std::cout << "CheckSparse: " << (same_labels && same_inertia ? "PASSED" : "FAILED") << std::endl;
+
+    return same_labels && same_inertia;
+}
+
+bool CheckDeterministic(){
+
+    // several deterministic blocks and a row length that needs padding
+    const std::size_t ROWS = 20000;
+    const std::size_t COLS = 13;
+    const int N_CLUSTER = 8;
+    const int SEED = 42;
+
+    const std::vector<double> data = ClusteredRows(ROWS, COLS, N_CLUSTER, SEED);
+    const int max_threads = omp_get_max_threads();
+
+    auto fit = [&](const int n_threads, const ParallelBackend backend) {
+
+        omp_set_num_threads(n_threads);
+
+        auto kmeans = std::make_unique<Parallel_KMeans<double, std::size_t>>(N_CLUSTER, MAX_ITER, TOL, SEED);
+        kmeans->deterministic = true;
+        kmeans->parallel_backend = backend;
+        kmeans->fit(data.data(), ROWS, COLS, COLS);
+
+        omp_set_num_threads(max_threads);
+        return kmeans;
+    };
+
+    const auto reference = fit(1, ParallelBackend::OpenMP);
+    bool passed = true;
+
+    for (const int n_threads : {2, 3, max_threads, -1})
+    {
+        // -1 is the thread pool with all of its threads
+        const auto kmeans = n_threads > 0 ? fit(n_threads, ParallelBackend::OpenMP) : fit(max_threads, ParallelBackend::ThreadPool);
+
+        const bool same = kmeans->centroids == reference->centroids && kmeans->labels == reference->labels
+                          && kmeans->inertia == reference->inertia && kmeans->n_iter == reference->n_iter;
+
+        if (!same)
+        {
+            std::cout << "Deterministic fit with " << (n_threads > 0 ? std::to_string(n_threads) + " threads" : "the thread pool")
+                      << " differs from the fit with 1 thread" << std::endl;
+            passed = false;
+        }
+    }
+
+    std::cout << "CheckDeterministic: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    return passed;
+}
+
+bool CheckResume(){
+
+    const std::size_t ROWS = 5000;
+    const std::size_t COLS = 7;
+    // more clusters than centers so the fit needs enough iterations for a checkpoint before it converges
+    const int N_CLUSTER = 12;
+    const int SEED = 7;
+    const int CHECKPOINT_EVERY = 2;
+
+    const std::vector<double> data = ClusteredRows(ROWS, COLS, 8, SEED);
+    const std::string checkpoint_file = (std::filesystem::temp_directory_path() / "kmeans_check_resume.ckpt").string();
+
+    Parallel_KMeans<double, std::size_t> reference(N_CLUSTER, MAX_ITER, TOL, SEED);
+    reference.deterministic = true;
+    reference.fit(data.data(), ROWS, COLS, COLS);
+
+    // the same fit writes checkpoints, the last one is from an iteration before the one that converged
+    Parallel_KMeans<double, std::size_t> checkpointed(N_CLUSTER, MAX_ITER, TOL, SEED);
+    checkpointed.deterministic = true;
+    checkpointed.checkpoint_file = checkpoint_file;
+    checkpointed.checkpoint_every = CHECKPOINT_EVERY;
+    checkpointed.fit(data.data(), ROWS, COLS, COLS);
+
+    bool passed = reference.n_iter > CHECKPOINT_EVERY;
+    if (!passed)
+    {
+        std::cout << "The fit converged after " << reference.n_iter << " iterations before the first checkpoint" << std::endl;
+    }
+
+    auto resumed = passed ? Parallel_KMeans<double, std::size_t>::resume(checkpoint_file) : nullptr;
+    if (passed && !resumed)
+    {
+        std::cout << "Could not resume from " << checkpoint_file << std::endl;
+        passed = false;
+    }
+
+    if (resumed)
+    {
+        resumed->fit(data.data(), ROWS, COLS, COLS);
+
+        if (resumed->centroids != reference.centroids || resumed->n_iter != reference.n_iter || resumed->labels != reference.labels)
+        {
+            std::cout << "The resumed fit differs from the uninterrupted fit" << std::endl;
+            passed = false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove(checkpoint_file, error);
+
+    std::cout << "CheckResume: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    return passed;
+}
+
+bool CheckTopK(){
+
+    const std::size_t ROWS = 3000;
+    const std::size_t COLS = 11;
+    const int N_CLUSTER = 10;
+    const int M = 3;
+    const int SEED = 3;
+
+    const std::vector<double> data = ClusteredRows(ROWS, COLS, N_CLUSTER, SEED);
+
+    Parallel_KMeans<double, std::size_t> kmeans(N_CLUSTER, MAX_ITER, TOL, SEED);
+    kmeans.fit(data.data(), ROWS, COLS, COLS);
+
+    std::vector<int> labels(ROWS);
+    std::vector<double> distances(ROWS);
+    std::vector<int> top_indices(ROWS * M);
+    std::vector<double> top_distances(ROWS * M);
+
+    bool passed = kmeans.predict(data.data(), ROWS, COLS, COLS, labels.data(), distances.data())
+                  && kmeans.predictTopK(data.data(), ROWS, COLS, COLS, M, top_indices.data(), top_distances.data());
+
+    std::size_t mismatches = 0;
+    for (std::size_t row = 0; passed && row < ROWS; ++row)
+    {
+        const double* row_distances = &top_distances[row * M];
+        const bool sorted = std::is_sorted(row_distances, row_distances + M);
+        const bool nearest = top_indices[row * M] == labels[row] && std::abs(row_distances[0] - distances[row]) <= 1e-9 * (1.0 + distances[row]);
+
+        mismatches += !(sorted && nearest);
+    }
+
+    if (mismatches > 0)
+    {
+        std::cout << mismatches << " rows of predictTopK differ from predict" << std::endl;
+        passed = false;
+    }
+
+    std::cout << "CheckTopK: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    return passed;
+}
+
+bool CheckTransform(){
+
+    // a row count that leaves a remainder after the blocks of transform and a padded output matrix
+    const std::size_t ROWS = 1003;
+    const std::size_t COLS = 9;
+    const int N_CLUSTER = 6;
+    const std::size_t DISTANCE_STRIDE = N_CLUSTER + 3;
+    const int SEED = 5;
+
+    const std::vector<double> data = ClusteredRows(ROWS, COLS, N_CLUSTER, SEED);
+
+    Parallel_KMeans<double, std::size_t> kmeans(N_CLUSTER, MAX_ITER, TOL, SEED);
+    kmeans.fit(data.data(), ROWS, COLS, COLS);
+
+    std::vector<double> squared(ROWS * DISTANCE_STRIDE);
+    std::vector<double> distances(ROWS * DISTANCE_STRIDE);
+
+    bool passed = kmeans.transform(data.data(), ROWS, COLS, COLS, squared.data(), DISTANCE_STRIDE, true)
+                  && kmeans.transform(data.data(), ROWS, COLS, COLS, distances.data(), DISTANCE_STRIDE);
+
+    // the SIMD kernels of squaredDistance need aligned rows, so every row is compared in a zero padded copy
+    std::vector<double, AlignedAllocator<double>> row_buffer(kmeans.row_stride, 0.0);
+
+    std::size_t mismatches = 0;
+    for (std::size_t row = 0; passed && row < ROWS; ++row)
+    {
+        const double* row_ptr = &data[row * COLS];
+        std::copy(row_ptr, row_ptr + COLS, row_buffer.begin());
+
+        for (int centroid_idx = 0; centroid_idx < N_CLUSTER; ++centroid_idx)
+        {
+            const double* centroid_ptr = &kmeans.centroids[centroid_idx * kmeans.row_stride];
+            const double expected = squaredDistance(row_buffer.data(), centroid_ptr, kmeans.row_stride);
+
+            // the norm expansion loses digits relative to the norms, not to the distance
+            double norms = 1.0;
+            for (std::size_t col = 0; col < COLS; ++col)
+            {
+                norms += row_ptr[col] * row_ptr[col] + centroid_ptr[col] * centroid_ptr[col];
+            }
+
+            const double value = squared[row * DISTANCE_STRIDE + centroid_idx];
+            const double distance = distances[row * DISTANCE_STRIDE + centroid_idx];
+
+            mismatches += std::abs(value - expected) > 1e-12 * norms || std::abs(distance * distance - expected) > 1e-12 * norms;
+        }
+    }
+
+    if (mismatches > 0)
+    {
+        std::cout << mismatches << " distances of transform differ from squaredDistance" << std::endl;
+        passed = false;
+    }
+
+    std::cout << "CheckTransform: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    return passed;
+}
+
+bool CheckNpy(){
+
+    const std::size_t ROWS = 257;
+    const std::size_t COLS = 5;
+
+    const std::vector<double> data = ClusteredRows(ROWS, COLS, 4, 11);
+    const std::string filename = (std::filesystem::temp_directory_path() / "kmeans_check.npy").string();
+
+    // float64 is read into the padded layout, float32 is also converted
+    auto round_trip = [&](auto stored_type) {
+
+        using StoredType = decltype(stored_type);
+
+        Dataset<double> dataset;
+        if (!WriteNpy<StoredType>(filename, data, ROWS, COLS) || !readNpy(filename, dataset))
+        {
+            return false;
+        }
+
+        bool same = dataset.rows == ROWS && dataset.cols == COLS && dataset.stride == alignedRowSize<double>(COLS) && dataset.labels.empty();
+
+        for (std::size_t row = 0; same && row < ROWS; ++row)
+        {
+            for (std::size_t col = 0; col < dataset.stride; ++col)
+            {
+                const double expected = col < COLS ? static_cast<double>(static_cast<StoredType>(data[row * COLS + col])) : 0.0;
+                same &= dataset.row(row)[col] == expected;
+            }
+        }
+
+        if (!same)
+        {
+            std::cout << "The float" << sizeof(StoredType) * 8 << " .npy file was not read back unchanged" << std::endl;
+        }
+
+        return same;
+    };
+
+    const bool passed = round_trip(double()) && round_trip(float());
+
+    std::error_code error;
+    std::filesystem::remove(filename, error);
+
+    std::cout << "CheckNpy: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    return passed;
+}
+
+bool CheckDatasetCache(){
+
+    const std::size_t ROWS = 3000;
+    const std::size_t COLS = 6;
+    const int N_CLUSTER = 5;
+
+    const std::vector<double> data = ClusteredRows(ROWS, COLS, N_CLUSTER, 13);
+    const std::string filename = (std::filesystem::temp_directory_path() / "kmeans_check.kmcache").string();
+
+    Dataset<double> dataset;
+    dataset.rows = ROWS;
+    dataset.cols = COLS;
+    dataset.stride = alignedRowSize<double>(COLS);
+    dataset.values.assign(ROWS * dataset.stride, 0.0);
+    dataset.labels.resize(ROWS);
+
+    for (std::size_t row = 0; row < ROWS; ++row)
+    {
+        std::copy(&data[row * COLS], &data[row * COLS] + COLS, dataset.row(row));
+        dataset.labels[row] = static_cast<int>(row % N_CLUSTER);
+    }
+
+    auto same_dataset = [&dataset](const Dataset<double>& other) {
+
+        return other.rows == dataset.rows && other.cols == dataset.cols && other.stride == dataset.stride && other.labels == dataset.labels
+               && std::equal(dataset.data(), dataset.data() + dataset.rows * dataset.stride, other.data());
+    };
+
+    bool passed = true;
+
+    for (const bool compress : {false, true})
+    {
+        Dataset<double> cached;
+        if (!writeDatasetCache(filename, dataset, compress) || !readDatasetCache(filename, cached, "", true) || !same_dataset(cached))
+        {
+            std::cout << "The " << (compress ? "compressed" : "uncompressed") << " cache was not read back unchanged" << std::endl;
+            passed = false;
+        }
+    }
+
+    // a changed label at the end of an uncompressed cache has to fail the checksum, which is only compared on request
+    if (writeDatasetCache(filename, dataset))
+    {
+        {
+            std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(-1, std::ios::end);
+            file.put(1);
+        }
+
+        Dataset<double> corrupted;
+        if (readDatasetCache(filename, corrupted, "", true))
+        {
+            std::cout << "A corrupted cache passed the checksum" << std::endl;
+            passed = false;
+        }
+
+        if (!readDatasetCache(filename, corrupted) || corrupted.labels.back() == dataset.labels.back())
+        {
+            std::cout << "A cache was not loaded without the checksum" << std::endl;
+            passed = false;
+        }
+    }
+    else
+    {
+        passed = false;
+    }
+
+    std::error_code error;
+    std::filesystem::remove(filename, error);
+
+    std::cout << "CheckDatasetCache: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    return passed;
+}
+#endif
+
 template <typename FType>
 void CheckData(std::vector<std::vector<FType>>& data){
 
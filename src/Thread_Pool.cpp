@@ -0,0 +1,342 @@
+#include <Thread_Pool.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+// the chunks of a slot are the range [front, back) packed into one word, so taking a chunk from the front (owner)
+// and taking half of the chunks from the back (thief) are single compare and swaps on the same word
+constexpr std::uint64_t RANGE_MASK = 0xFFFFFFFF;
+constexpr std::size_t MAX_CHUNKS = std::size_t(1) << 31;
+
+inline std::uint64_t packRange(const std::uint64_t front, const std::uint64_t back) {
+    return (front << 32) | back;
+}
+
+struct alignas(64) ChunkRange {
+    std::atomic<std::uint64_t> range{0};
+};
+
+}
+
+struct ThreadPool::Loop {
+
+    ChunkFunction function;
+    void* context;
+
+    std::size_t n;
+    std::size_t chunk_size;
+    std::size_t n_slots;
+
+    std::unique_ptr<ChunkRange[]> ranges;
+
+    // the calling thread has slot 0, joining workers take the next free one
+    std::atomic<std::size_t> next_slot{1};
+    std::atomic<std::size_t> remaining;
+
+    std::mutex done_mutex;
+    std::condition_variable done;
+
+    bool hasChunks() const {
+
+        for (std::size_t slot = 0; slot < n_slots; ++slot)
+        {
+            const std::uint64_t range = ranges[slot].range.load(std::memory_order_relaxed);
+
+            if ((range >> 32) < (range & RANGE_MASK))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // takes the first chunk of the own slot
+    bool pop(const std::size_t slot, std::size_t& chunk) {
+
+        std::atomic<std::uint64_t>& own = ranges[slot].range;
+        std::uint64_t range = own.load();
+
+        while ((range >> 32) < (range & RANGE_MASK))
+        {
+            if (own.compare_exchange_weak(range, packRange((range >> 32) + 1, range & RANGE_MASK)))
+            {
+                chunk = range >> 32;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // moves the back half of the chunks of another slot into the own (empty) slot
+    bool steal(const std::size_t slot) {
+
+        for (std::size_t offset = 1; offset < n_slots; ++offset)
+        {
+            std::atomic<std::uint64_t>& victim = ranges[(slot + offset) % n_slots].range;
+            std::uint64_t range = victim.load();
+
+            while ((range >> 32) < (range & RANGE_MASK))
+            {
+                const std::uint64_t front = range >> 32;
+                const std::uint64_t back = range & RANGE_MASK;
+                const std::uint64_t split = back - (back - front + 1) / 2;
+
+                if (victim.compare_exchange_weak(range, packRange(front, split)))
+                {
+                    ranges[slot].range.store(packRange(split, back));
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void work(const std::size_t slot) {
+
+        std::size_t chunk;
+
+        while (true)
+        {
+            if (!pop(slot, chunk))
+            {
+                // a thread only leaves once all slots were empty, chunks are never left in the slot of a thread that left
+                if (!steal(slot))
+                {
+                    return;
+                }
+
+                continue;
+            }
+
+            const std::size_t first = chunk * chunk_size;
+            function(context, first, std::min(n, first + chunk_size), slot);
+
+            if (remaining.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+};
+
+ThreadPool& ThreadPool::shared() {
+
+    static ThreadPool pool([]() -> std::size_t {
+
+        if (const char* threads = std::getenv("KMEANS_POOL_THREADS"))
+        {
+            const long value = std::strtol(threads, nullptr, 10);
+
+            if (value > 0)
+            {
+                return value;
+            }
+        }
+
+        return std::max(1u, std::thread::hardware_concurrency());
+    }());
+
+    return pool;
+}
+
+ThreadPool::ThreadPool(const std::size_t n_threads) {
+
+    for (std::size_t worker = 1; worker < n_threads; ++worker)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+std::size_t ThreadPool::slots() const {
+
+    return workers.size() + 1;
+}
+
+void ThreadPool::run(const std::size_t n, const std::size_t grain, ChunkFunction function, void* context) {
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    const std::size_t chunk_size = std::max({grain, std::size_t(1), (n + MAX_CHUNKS - 1) / MAX_CHUNKS});
+    const std::size_t n_chunks = (n + chunk_size - 1) / chunk_size;
+
+    // nothing to share, the loop runs on the calling thread without touching the pool
+    if (n_chunks == 1 || workers.empty())
+    {
+        function(context, 0, n, 0);
+        return;
+    }
+
+    auto loop = std::make_shared<Loop>();
+    loop->function = function;
+    loop->context = context;
+    loop->n = n;
+    loop->chunk_size = chunk_size;
+    loop->n_slots = std::min(slots(), n_chunks);
+    loop->ranges = std::make_unique<ChunkRange[]>(loop->n_slots);
+    loop->remaining = n_chunks;
+
+    // contiguous chunks per slot like a static schedule, stealing only moves chunks once a slot runs dry
+    for (std::size_t slot = 0; slot < loop->n_slots; ++slot)
+    {
+        loop->ranges[slot].range.store(packRange(n_chunks * slot / loop->n_slots, n_chunks * (slot + 1) / loop->n_slots));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loops.push_back(loop);
+    }
+
+    wake.notify_all();
+
+    loop->work(0);
+
+    // every chunk is taken, no worker can help anymore
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loops.erase(std::find(loops.begin(), loops.end(), loop));
+    }
+
+    // the chunks still running on workers use context, which lives on the stack of the caller
+    std::unique_lock<std::mutex> lock(loop->done_mutex);
+    loop->done.wait(lock, [&]() { return loop->remaining.load() == 0; });
+}
+
+std::shared_ptr<ThreadPool::Loop> ThreadPool::nextLoop() {
+
+    // round robin over the running loops so concurrent fits get the workers in turn
+    for (std::size_t offset = 0; offset < loops.size(); ++offset)
+    {
+        const std::size_t index = (next_loop + offset) % loops.size();
+        const std::shared_ptr<Loop>& loop = loops[index];
+
+        if (loop->next_slot.load() < loop->n_slots && loop->hasChunks())
+        {
+            next_loop = index + 1;
+            return loop;
+        }
+    }
+
+    return nullptr;
+}
+
+void ThreadPool::workerLoop() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        std::shared_ptr<Loop> loop;
+        wake.wait(lock, [&]() { return stopping || (loop = nextLoop()) != nullptr; });
+
+        if (stopping)
+        {
+            return;
+        }
+
+        const std::size_t slot = loop->next_slot.fetch_add(1);
+
+        lock.unlock();
+
+        if (slot < loop->n_slots)
+        {
+            loop->work(slot);
+        }
+
+        lock.lock();
+    }
+}
+
+BackgroundThread::BackgroundThread() : thread(&BackgroundThread::threadLoop, this) {}
+
+BackgroundThread::~BackgroundThread() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    changed.notify_all();
+    thread.join();
+}
+
+void BackgroundThread::submit(std::function<bool()> job) {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_job = std::move(job);
+        running = true;
+    }
+
+    changed.notify_all();
+}
+
+bool BackgroundThread::wait() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&]() { return !running; });
+
+    const bool job_result = result;
+    result = true;
+    return job_result;
+}
+
+void BackgroundThread::threadLoop() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        changed.wait(lock, [&]() { return stopping || pending_job; });
+
+        // a job that was submitted is always run, its caller waits for it
+        if (!pending_job)
+        {
+            return;
+        }
+
+        std::function<bool()> job = std::move(pending_job);
+        pending_job = nullptr;
+
+        lock.unlock();
+        const bool job_result = job();
+        lock.lock();
+
+        result = job_result;
+        running = false;
+        changed.notify_all();
+    }
+}
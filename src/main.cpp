@@ -8,6 +8,15 @@
 
 #include <utils.h>
 #include <Tests.h>
+#include <Data_Loader.h>
+#include <Dataset_Cache.h>
+#include <File_Chunk_Source.h>
+#include <Preprocessing.h>
+
+#ifdef USE_CONT_MEM
+#include <Bulk_Predict.h>
+#endif
+#include <Dataset.h>
 
 #include <vector>
 #include <iostream>
@@ -21,13 +30,12 @@
 #include <cstring>
 #include <omp.h>
 #include <filesystem>
+#include <tuple>
+#include <memory>
 
 using IMAGE_DATA_TYPE = float;
 using ITYPE = std::size_t;
 
-// Image size of the MNIST data set
-const ITYPE IMAGE_SIZE = 28 * 28;
-
 // Parameters for the KMeans Algorithm
 const double TOL = 1e-9;
 const int N_CLUSTER = 10;
@@ -45,218 +53,343 @@ const int SEED = 42;
 void print_usage() {
 
     std::cout << "Usage: program --data <filepath> --output <filepath> [--verbose]" << std::endl;
+    std::cout << "       program predict ... (flat array implementation only, see program predict --help)" << std::endl;
+    std::cout << "       program latency ... (flat array implementation only, see program latency --help)" << std::endl;
+    std::cout << "       program check           Run the self checks, the exit code is 1 if one fails (flat array implementation only)" << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "--data <filepathe>        Provide path to data input" << std::endl;
+    std::cout << "--data <filepathe>        Provide path to data input (ARFF/CSV/IDX, optionally gzipped, or .npy)" << std::endl;
+    std::cout << "--format <format>        Format of the data input: auto (default, from the file name), arff, csv, npy, idx or cache" << std::endl;
+    std::cout << "--labels <filepath>      IDX1 file with the labels of an IDX data input" << std::endl;
+    std::cout << "--label_column <column>  Label column of an ARFF/CSV data input: last (default), first or none" << std::endl;
+    std::cout << "--no_cache               Do not read or write the binary cache <data>.kmcache next to the data input" << std::endl;
+    std::cout << "--compress_cache         Write the binary cache as compressed blocks" << std::endl;
+    std::cout << "--verify_cache           Compare the checksum of every value and label when the binary cache is loaded" << std::endl;
+    std::cout << "--scaling <scaling>      Scale the loaded data: none (default), standard, minmax or l2" << std::endl;
     std::cout << "--output <filepath>  Specify path output file" << std::endl;
     std::cout << "--timing_iterations <value> Number of iterations to time the KMeans implementation" << std::endl;
+    std::cout << "--out_of_core            Stream the rows of a .npy or uncompressed .kmcache file in every iteration (flat array implementation only)" << std::endl;
+    std::cout << "--deterministic          Results independent of OMP_NUM_THREADS (flat array implementation only)" << std::endl;
+    std::cout << "--thread_pool            Run the parallel loops on the work stealing thread pool, KMEANS_POOL_THREADS threads (flat array implementation only)" << std::endl;
+    std::cout << "--init_model <filepath>  Start every fit from the centroids of a saved model (flat array implementation only)" << std::endl;
+    std::cout << "--save_model <filepath>  Save the last fitted model as a binary model file (flat array implementation only)" << std::endl;
+    std::cout << "--checkpoint <filepath>  Write checkpoints of the running fit to this file (flat array implementation only)" << std::endl;
+    std::cout << "--checkpoint_every <value>   Write a checkpoint every <value> iterations" << std::endl;
+    std::cout << "--checkpoint_seconds <value> Write a checkpoint every <value> seconds" << std::endl;
+    std::cout << "--resume <filepath>      Continue the fit of a checkpoint (flat array implementation only)" << std::endl;
     std::cout << "--verbose                Enable verbose mode" << std::endl;
 }
 
-bool endsWithGZ(const std::string& path) {
-
-    const std::string extension = ".gz";
-
-    // Check if the path is at least as long as the extension
-    if (path.length() >= extension.length()) 
-    {
-        // Extract the last 3 characters and compare with ".gz"
-        return path.compare(path.length() - extension.length(), extension.length(), extension) == 0;
-    }
+#ifdef USE_CONT_MEM
+void print_predict_usage() {
 
-    // If the string is too short, it can't have the extension
-    return false;
+    std::cout << "Usage: program predict (--model <filepath> | --centroids <filepath>) --data <filepath> --output <filepath> [--text] [--distances]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "--model <filepath>       Model file written by --save_model" << std::endl;
+    std::cout << "--centroids <filepath>   File with one centroid per row (any --data format, e.g. .npy)" << std::endl;
+    std::cout << "--data <filepath>        Rows to predict: ARFF/CSV (optionally gzipped), .npy or uncompressed .kmcache" << std::endl;
+    std::cout << "--format <format>        Format of the data input: auto (default, from the file name), arff, csv, npy or cache" << std::endl;
+    std::cout << "--label_column <column>  Label column of an ARFF/CSV data input: last (default), first or none" << std::endl;
+    std::cout << "--output <filepath>      Labels as int32 (distances in <filepath>.distances) or text with --text" << std::endl;
+    std::cout << "--text                   Write one line per row instead of binary output" << std::endl;
+    std::cout << "--distances              Also write the distance of every row to its centroid" << std::endl;
+    std::cout << "--chunk_rows <value>     Number of rows that are read and predicted at once" << std::endl;
 }
 
-template <typename FType>
-void readImagesAndLabelsGzip(const char* filename, std::vector<std::vector<float>> &images, std::vector<int> &labels, int image_size) {
-
-    gzFile gz_file = gzopen(filename, "rb");  // Open the gzipped file in binary mode
-    if (!gz_file) {
-        std::cerr << "Error: Cannot open gzipped file " << filename << std::endl;
-        exit(1);
-    }
-
-    // Buffer size is 4096 because max chars in line = 784 (IMAGE_SIZE) * 3 (at most 3 chars for pixel values) + 784 (commas) + 1 (label) + 2 (newline and \0)
-    // so at most = 3139 bytes
-    const int buffer_size = 4096; 
-    char buffer[buffer_size];
+// KMeans predict: labels a data file of any size with fixed centroids, the input is streamed in chunks
+int run_predict(int argc, char* argv[]) {
 
+    std::string model_filename;
+    std::string centroids_filename;
+    std::string filename;
+    std::string output_file;
+    DataFormat data_format = DataFormat::Auto;
+    LabelColumn label_column = LabelColumn::Last;
+    PredictionFormat output_format = PredictionFormat::Binary;
+    bool write_distances = false;
+    std::size_t chunk_rows = std::size_t(1) << 16;
 
-    size_t image_count = 0;
-    const char* start = "@data";
-    bool found_start = false;
-
-    std::cout << "Start processing the images" << std::endl;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const bool has_value = i + 1 < argc && argv[i + 1][0] != '-';
 
-    while (gzgets(gz_file, buffer, buffer_size)) {
-        
-        if (!found_start)
+        if (arg == "--model" && has_value)
+        {
+            model_filename = argv[++i];
+        }
+        else if (arg == "--centroids" && has_value)
+        {
+            centroids_filename = argv[++i];
+        }
+        else if (arg == "--data" && has_value)
+        {
+            filename = argv[++i];
+        }
+        else if (arg == "--output" && has_value)
         {
-        for (const char* ptr = buffer; *ptr != '\0'; ++ptr)
+            output_file = argv[++i];
+        }
+        else if (arg == "--format" && has_value)
         {
-            bool match = true;
-            for (std::size_t i = 0; i < std::strlen(start); ++i)
+            if (!parseDataFormat(argv[++i], data_format))
             {
-                if (std::tolower(static_cast<unsigned char>(ptr[i])) != std::tolower(static_cast<unsigned char>(start[i])))
-                {
-                    match = false;
-                    break;
-                }
+                std::cerr << "--format unknown data format: " << argv[i] << std::endl;
+                print_predict_usage();
+                return 1;
             }
-
-            if (match == true)
+        }
+        else if (arg == "--label_column" && has_value)
+        {
+            if (!parseLabelColumn(argv[++i], label_column))
             {
-                found_start = true;
-                break;
+                std::cerr << "--label_column requires one of none, first or last" << std::endl;
+                print_predict_usage();
+                return 1;
             }
         }
+        else if (arg == "--chunk_rows" && has_value)
+        {
+            chunk_rows = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--text")
+        {
+            output_format = PredictionFormat::Text;
+        }
+        else if (arg == "--distances")
+        {
+            write_distances = true;
         }
         else
         {
-            std::vector<FType> image (image_size, 0);
-            std::string tmp;
-            std::size_t counter = 0;
-            // Read pixel values for the image
-            for (const char* ch = buffer; *ch != '\0'; ++ch){
-            
-                if (*ch == ',')
-                {
-                    image[counter] = std::stof(tmp);
-                    tmp.clear();
-                    counter += 1;
-                }
-                else if (*ch == '\n')
-                {
-                    continue;
-                }
-                else {
-                    tmp.push_back(*ch);
-                }
-            }
-
-
-            if (!tmp.empty())
-            {
-                labels.push_back(std::stof(tmp));
-            }
-
-            if (image.empty())
-            {
-                std::cerr << "image is empty" << std::endl;
-            }
-            
-            // sanity check to ensure that all the images have been read correctly
-            if (image.size() != image_size)
-            {
-                std::cout << "Image size " << image.size() << std::endl;
-                std::cout << "size of image "<< image_count << " is not correct" << std::endl;
-            }
+            std::cerr << "Unknown Argument or missing value: " << arg << std::endl;
+            print_predict_usage();
+            return 1;
+        }
+    }
 
+    if (model_filename.empty() == centroids_filename.empty() || filename.empty() || output_file.empty())
+    {
+        std::cerr << "predict requires either --model or --centroids, --data and --output" << std::endl;
+        print_predict_usage();
+        return 1;
+    }
 
-            images.push_back(image); 
-            image_count += 1;
+    std::unique_ptr<Parallel_KMeans<IMAGE_DATA_TYPE>> kmeans;
 
+    if (!model_filename.empty())
+    {
+        kmeans = Parallel_KMeans<IMAGE_DATA_TYPE>::load(model_filename);
+    }
+    else
+    {
+        // a centroid file has no label column, every column of a CSV is a feature
+        Dataset<IMAGE_DATA_TYPE> centroids;
+        if (!readDataset<IMAGE_DATA_TYPE>(centroids_filename, centroids, DataFormat::Auto, "", LabelColumn::None))
+        {
+            std::cerr << "Failed to read the centroids " << centroids_filename << std::endl;
+            return 1;
+        }
 
+        kmeans = std::make_unique<Parallel_KMeans<IMAGE_DATA_TYPE>>(centroids.rows, MAX_ITER, TOL, SEED);
+        if (!kmeans->setCentroids(centroids.data(), centroids.rows, centroids.cols, centroids.stride))
+        {
+            kmeans.reset();
         }
+    }
 
+    if (!kmeans)
+    {
+        return 1;
     }
 
-    std::cout << "Image processing has ended" << std::endl;
-    std::cout << "The Image count is " << image_count << std::endl;
-    
-    if (gzclose(gz_file) != Z_OK) {
-    std::cerr << "Error: Failed to close the gzipped file" << std::endl;
-    return;
+    std::unique_ptr<RowStream<IMAGE_DATA_TYPE>> input = openRowStream<IMAGE_DATA_TYPE>(filename, data_format, label_column);
+    if (!input)
+    {
+        std::cerr << "Failed to open the data file " << filename << std::endl;
+        return 1;
     }
 
-    std::cout << "File closed successfully." << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool success = predictStream(*kmeans, *input, output_file, output_format, write_distances, chunk_rows);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    std::cout << "Predict time: " << elapsed.count() << " ms" << std::endl;
+
+    return success ? 0 : 1;
 }
 
+void print_latency_usage() {
 
-template <typename FType>
-void readImagesAndLabels(const std::string &filename, std::vector<std::vector<float>> &images, std::vector<int> &labels, int image_size) {
+    std::cout << "Usage: program latency --model <filepath> --data <filepath> [--batch_sizes <list>] [--repeats <value>]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "--model <filepath>       Model file written by --save_model" << std::endl;
+    std::cout << "--data <filepath>        Rows the batches are taken from (any --data format)" << std::endl;
+    std::cout << "--format <format>        Format of the data input: auto (default, from the file name), arff, csv, npy, idx or cache" << std::endl;
+    std::cout << "--label_column <column>  Label column of an ARFF/CSV data input: last (default), first or none" << std::endl;
+    std::cout << "--batch_sizes <list>     Comma separated batch sizes (default 1,4,16,64,256,1024)" << std::endl;
+    std::cout << "--repeats <value>        Timed predict calls per batch size and path (default 2000)" << std::endl;
+}
 
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Cannot open file " << filename << std::endl;
-        exit(1);
-    }
+// p50 and p99 latency in microseconds of repeats predict calls on batches of batch_rows consecutive rows
+std::pair<double, double> predict_latency(const Parallel_KMeans<IMAGE_DATA_TYPE>& kmeans, const Dataset<IMAGE_DATA_TYPE>& dataset, const std::size_t batch_rows, const int repeats, std::vector<int>& labels) {
 
-    std::string line;
+    std::vector<double> latencies(repeats);
+    const std::size_t n_batches = dataset.rows - batch_rows + 1;
 
-    std::cout << "Opening the file" << std::endl;
-    // Find the @Data marker
-    while (std::getline(file, line)) {
-        line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
-        if (line == "@Data" || line == "@data" || line == "@DATA") {
-            std::cout << "Found @Data line" << std::endl;
-            break;
-        }
-    }
+    // a few calls first so the caches and, for the parallel path, the OpenMP threads are warm
+    for (int repeat = -repeats / 10; repeat < repeats; ++repeat)
+    {
+        const IMAGE_DATA_TYPE* batch = dataset.data() + (static_cast<std::size_t>(repeat + repeats) * batch_rows % n_batches) * dataset.stride;
 
-    std::size_t image_count = 0;
-    // Read the images and labels data
-    std::cout << "Start processing the images" << std::endl;
-    while (std::getline(file, line)) {
-        if (line.empty()) 
+        auto start = std::chrono::steady_clock::now();
+        // the rows of a Dataset are zero padded, so the padded overload reads them in place
+        kmeans.predict(batch, batch_rows, labels.data());
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (repeat >= 0)
         {
-            continue; // Skip empty lines
+            latencies[repeat] = elapsed.count();
         }
+    }
 
-        else
-        {
-            std::vector<FType> image (image_size, 0);
-            size_t counter = 0;
-            std::string tmp;
+    std::sort(latencies.begin(), latencies.end());
 
-            // Read pixel values for the image
-            for (char ch: line)
-            {
-                
-                if (ch == ',')
-                {
-                    
-                    image[counter] = std::stof(tmp);
-                    tmp.clear();
-                    counter += 1;
-                }
-                else 
-                {
-                    tmp.push_back(ch);
-                }
-            }
+    return {latencies[repeats / 2], latencies[std::min<std::size_t>(repeats - 1, static_cast<std::size_t>(repeats) * 99 / 100)]};
+}
+
+// KMeans latency: p50/p99 of predict per batch size, for the small batch path on the calling thread and the OpenMP path
+int run_latency(int argc, char* argv[]) {
+
+    std::string model_filename;
+    std::string filename;
+    DataFormat data_format = DataFormat::Auto;
+    LabelColumn label_column = LabelColumn::Last;
+    std::vector<std::size_t> batch_sizes{1, 4, 16, 64, 256, 1024};
+    int repeats = 2000;
 
-            // the last value which is the label is not pushed into the image vector 
-            // because the lookback value is only saved if a comma i read after the value which is not the case for the last 
-            // value that is the label
-            if (!tmp.empty())
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const bool has_value = i + 1 < argc && argv[i + 1][0] != '-';
+
+        if (arg == "--model" && has_value)
+        {
+            model_filename = argv[++i];
+        }
+        else if (arg == "--data" && has_value)
+        {
+            filename = argv[++i];
+        }
+        else if (arg == "--format" && has_value)
+        {
+            if (!parseDataFormat(argv[++i], data_format))
             {
-                labels.push_back(std::stoi(tmp));
+                std::cerr << "--format unknown data format: " << argv[i] << std::endl;
+                print_latency_usage();
+                return 1;
             }
-        
-            if (image.empty())
+        }
+        else if (arg == "--label_column" && has_value)
+        {
+            if (!parseLabelColumn(argv[++i], label_column))
             {
-                std::cerr << "image is empty" << std::endl;
+                std::cerr << "--label_column requires one of none, first or last" << std::endl;
+                print_latency_usage();
+                return 1;
             }
-            
-            // sanity check to ensure that all the images have been read correctly
-            else if (image.size() != image_size)
+        }
+        else if (arg == "--batch_sizes" && has_value)
+        {
+            batch_sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string size;
+
+            while (std::getline(list, size, ','))
             {
-        
-                std::cout << "size of image "<< image_count << " is not correct" << std::endl;
+                batch_sizes.push_back(std::max(1, std::stoi(size)));
             }
+        }
+        else if (arg == "--repeats" && has_value)
+        {
+            repeats = std::max(1, std::stoi(argv[++i]));
+        }
+        else
+        {
+            std::cerr << "Unknown Argument or missing value: " << arg << std::endl;
+            print_latency_usage();
+            return 1;
+        }
+    }
+
+    if (model_filename.empty() || filename.empty())
+    {
+        std::cerr << "latency requires --model and --data" << std::endl;
+        print_latency_usage();
+        return 1;
+    }
+
+    std::unique_ptr<Parallel_KMeans<IMAGE_DATA_TYPE>> kmeans = Parallel_KMeans<IMAGE_DATA_TYPE>::load(model_filename);
+    Dataset<IMAGE_DATA_TYPE> dataset;
+
+    if (!kmeans || !readDataset<IMAGE_DATA_TYPE>(filename, dataset, data_format, "", label_column))
+    {
+        std::cerr << "Failed to read the model or the data" << std::endl;
+        return 1;
+    }
+
+    if (dataset.cols != kmeans->n_features)
+    {
+        std::cerr << "The data has " << dataset.cols << " features but the model " << kmeans->n_features << std::endl;
+        return 1;
+    }
 
-            images.push_back(image); 
-            image_count += 1;
+    const std::size_t small_batch_rows = kmeans->small_batch_rows;
+    std::vector<int> labels(*std::max_element(batch_sizes.begin(), batch_sizes.end()));
+
+    std::cout << "Threads: " << omp_get_max_threads() << " small_batch_rows: " << small_batch_rows << " repeats: " << repeats << std::endl;
+
+    for (const std::size_t batch_rows : batch_sizes)
+    {
+        if (batch_rows > dataset.rows)
+        {
+            std::cerr << "Skipping batch size " << batch_rows << ", the data has only " << dataset.rows << " rows" << std::endl;
+            continue;
         }
+
+        kmeans->small_batch_rows = small_batch_rows;
+        const auto [default_p50, default_p99] = predict_latency(*kmeans, dataset, batch_rows, repeats, labels);
+
+        // every batch through the OpenMP parallel region for comparison
+        kmeans->small_batch_rows = 0;
+        const auto [parallel_p50, parallel_p99] = predict_latency(*kmeans, dataset, batch_rows, repeats, labels);
+
+        std::cout << "Batch " << batch_rows
+                  << (batch_rows < small_batch_rows ? " small batch path" : " parallel path")
+                  << " p50: " << default_p50 << " us p99: " << default_p99 << " us"
+                  << " | always parallel p50: " << parallel_p50 << " us p99: " << parallel_p99 << " us" << std::endl;
     }
 
+    return 0;
+}
 
-    std::cout << "The Image count is " << image_count << std::endl;
-    std::cout << "Image processing has ended" << std::endl;
+// KMeans check: runs the self checks of Tests.cpp and fails if any of them fails
+int run_checks() {
 
-    file.close();
+    bool passed = true;
+
+    passed &= CheckSparse();
+    passed &= CheckDeterministic();
+    passed &= CheckResume();
+    passed &= CheckTopK();
+    passed &= CheckTransform();
+    passed &= CheckNpy();
+    passed &= CheckDatasetCache();
+
+    std::cout << (passed ? "All checks PASSED" : "Some checks FAILED") << std::endl;
+
+    return passed ? 0 : 1;
 }
+#endif
 
 int main(int argc, char* argv[]){
 
@@ -281,12 +414,39 @@ int main(int argc, char* argv[]){
         return 1; 
     }
 
-    std::vector<std::vector<float>> data;
-    std::vector<int> labels;
+    #ifdef USE_CONT_MEM
+    if (std::string(argv[1]) == "predict")
+    {
+        return run_predict(argc, argv);
+    }
+
+    if (std::string(argv[1]) == "latency")
+    {
+        return run_latency(argc, argv);
+    }
+
+    if (std::string(argv[1]) == "check")
+    {
+        return run_checks();
+    }
+    #endif
+
+    Dataset<IMAGE_DATA_TYPE> dataset;
     std::string filename;
+    std::string labels_filename;
+    DataFormat data_format = DataFormat::Auto;
+    LabelColumn label_column = LabelColumn::Last;
     std::string output_file;
     int timing_iterations;
     bool verbose = false;
+    bool use_cache = true;
+    bool compress_cache = false;
+    bool verify_cache = false;
+    #ifdef USE_CONT_MEM
+    bool out_of_core = false;
+    #endif
+    Scaling scaling = Scaling::None;
+    FitOptions fit_options;
 
     // check if all required arguments have values
     bool has_data = false;
@@ -323,6 +483,80 @@ int main(int argc, char* argv[]){
             }
         }
 
+        else if (arg == "--format")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                if (parseDataFormat(argv[++i], data_format))
+                {
+                    std::cout << "Data Format: " << argv[i] << std::endl;
+                }
+                else
+                {
+                    std::cerr << "--format unknown data format: " << argv[i] << std::endl;
+                    print_usage();
+                    return 1;
+                }
+            }
+            else 
+            {
+                std::cerr << "--format requires a valied value" << std::endl;
+                print_usage();
+                return 1;
+            }
+        }
+
+        else if (arg == "--scaling")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-' && parseScaling(argv[++i], scaling))
+            {
+                std::cout << "Scaling: " << argv[i] << std::endl;
+            }
+            else 
+            {
+                std::cerr << "--scaling requires one of none, standard, minmax or l2" << std::endl;
+                print_usage();
+                return 1;
+            }
+        }
+
+        else if (arg == "--label_column")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-' && parseLabelColumn(argv[++i], label_column))
+            {
+                std::cout << "Label Column: " << argv[i] << std::endl;
+            }
+            else 
+            {
+                std::cerr << "--label_column requires one of none, first or last" << std::endl;
+                print_usage();
+                return 1;
+            }
+        }
+
+        else if (arg == "--labels")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                if (std::filesystem::exists(argv[++i]))
+                {
+                    labels_filename = argv[i];
+                    std::cout << "Labels File Path: " << labels_filename << std::endl;
+                }
+                else
+                {
+                    std::cerr << "--labels filepath does not exist: " << argv[i] << std::endl;
+                    return 1; 
+                }
+            }
+            else 
+            {
+                std::cerr << "--labels Path requires a valied value" << std::endl;
+                print_usage();
+                return 1;
+            }
+        }
+
         else if (arg == "--output")
         {
             if (i + 1 < argc && argv[i + 1][0] != '-')
@@ -352,6 +586,68 @@ int main(int argc, char* argv[]){
             std::cout << "Verobse ENABLED" << std::endl;
             verbose = true;
         }
+        else if (arg == "--no_cache")
+        {
+            std::cout << "Data set cache DISABLED" << std::endl;
+            use_cache = false;
+        }
+        else if (arg == "--compress_cache")
+        {
+            std::cout << "Compressed data set cache ENABLED" << std::endl;
+            compress_cache = true;
+        }
+        else if (arg == "--verify_cache")
+        {
+            std::cout << "Data set cache checksum ENABLED" << std::endl;
+            verify_cache = true;
+        }
+        else if (arg == "--out_of_core")
+        {
+            #ifdef USE_CONT_MEM
+            std::cout << "Out of core fit ENABLED" << std::endl;
+            out_of_core = true;
+            #else
+            std::cerr << arg << " is only supported by the flat array implementation" << std::endl;
+            return 1;
+            #endif
+        }
+        else if (arg == "--deterministic")
+        {
+            std::cout << "Deterministic reductions ENABLED" << std::endl;
+            fit_options.deterministic = true;
+        }
+        else if (arg == "--thread_pool")
+        {
+            std::cout << "Thread pool backend ENABLED" << std::endl;
+            fit_options.thread_pool = true;
+        }
+        else if (arg == "--init_model" || arg == "--save_model" || arg == "--checkpoint" || arg == "--resume"
+                 || arg == "--checkpoint_every" || arg == "--checkpoint_seconds")
+        {
+            #ifdef USE_CONT_MEM
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                const std::string value = argv[++i];
+                std::cout << arg.substr(2) << ": " << value << std::endl;
+
+                if (arg == "--init_model") fit_options.init_model = value;
+                else if (arg == "--save_model") fit_options.save_model = value;
+                else if (arg == "--checkpoint") fit_options.checkpoint_file = value;
+                else if (arg == "--resume") fit_options.resume_checkpoint = value;
+                else if (arg == "--checkpoint_every") fit_options.checkpoint_every = std::stoi(value);
+                else fit_options.checkpoint_seconds = std::stod(value);
+            }
+            else 
+            {
+                std::cerr << arg << " requires a valied value" << std::endl;
+                print_usage();
+                return 1;
+            }
+            #else
+            std::cerr << arg << " is only supported by the flat array implementation" << std::endl;
+            return 1;
+            #endif
+        }
         else if (arg == "--timing_iterations")
         {
             if (i + 1 < argc && argv[i + 1][0] != '-')
@@ -418,16 +714,58 @@ int main(int argc, char* argv[]){
     std::cout << "Number of Iterations for timing: " << timing_iterations << std::endl;
 
 
-    if (endsWithGZ(filename))
+    std::tuple<std::vector<double>, std::vector<int>, double, double, double> timing_results;
+
+    #ifdef USE_CONT_MEM
+    // out of core: the rows are streamed from the .npy/.kmcache file in every iteration instead of being loaded
+    FileChunkSource<IMAGE_DATA_TYPE> source;
+
+    if (out_of_core)
     {
-        std::cout << "Parsing gzipped file" << std::endl;
-        const char* c_str_filename = filename.c_str();
-        readImagesAndLabelsGzip<IMAGE_DATA_TYPE>(c_str_filename, data, labels, IMAGE_SIZE);
-    }
+        if (scaling != Scaling::None)
+        {
+            std::cerr << "--scaling can not be used with --out_of_core, the streamed rows are not scaled" << std::endl;
+            return 1;
+        }
+
+        if (!source.open(filename, data_format))
+        {
+            std::cerr << "Failed to open the data file " << filename << " for streaming" << std::endl;
+            return 1;
+        }
 
+        timing_results = TimeParallelKMeans<IMAGE_DATA_TYPE, ITYPE>(N_CLUSTER, MAX_ITER, TOL, SEED, timing_iterations, source, fit_options);
+    }
     else
+    #endif
+    {
+    // .npy files are memory mapped, ARFF/CSV and IDX files can be plain or gzipped
+    // parsed files are stored as a binary cache next to the input which is mapped on the next run
+    // the delimited loader only accumulates the feature statistics if the scaling needs them
+    const bool collect_statistics = needsStatistics(scaling);
+    const bool loaded = use_cache ? readDatasetCached<IMAGE_DATA_TYPE>(filename, dataset, data_format, labels_filename, compress_cache, label_column, collect_statistics, verify_cache)
+                                  : readDataset<IMAGE_DATA_TYPE>(filename, dataset, data_format, labels_filename, label_column, collect_statistics);
+
+    if (!loaded)
+    {
+        std::cerr << "Failed to read the data file " << filename << std::endl;
+        return 1;
+    }
+
+    // the statistics are collected by the loader or stored in the cache, so scaling is one pass over the data
+    if (!scaleDataset(dataset, scaling))
     {
-        readImagesAndLabels<IMAGE_DATA_TYPE>(filename, data, labels, IMAGE_SIZE);
+        return 1;
+    }
+
+    #ifdef USE_CONT_MEM
+    // the flat implementation works on the loaded buffer directly
+    const Dataset<IMAGE_DATA_TYPE>& data = dataset;
+    #else
+    const std::vector<std::vector<IMAGE_DATA_TYPE>> data = dataset.to_nested();
+    #endif
+
+    timing_results = TimeParallelKMeans<IMAGE_DATA_TYPE, ITYPE>(N_CLUSTER, MAX_ITER, TOL, SEED, timing_iterations, data, fit_options);
     }
 
     // CheckLabels();
@@ -449,12 +787,7 @@ int main(int argc, char* argv[]){
     //                                                                                                                             TIMING_ITERATIONS, 
     //                                                                                                                             data);
 
-    auto [Parallel_KMeans_timings, Parallel_KMeans_iterations, Parallel_KMeans_average, Parallel_KMeans_min, Parallel_KMeans_max] = TimeParallelKMeans<float, std::size_t>(N_CLUSTER, 
-                                                                                                                                                                           MAX_ITER, 
-                                                                                                                                                                           TOL,
-                                                                                                                                                                           SEED, 
-                                                                                                                                                                           timing_iterations, 
-                                                                                                                                                                           data);
+    auto& [Parallel_KMeans_timings, Parallel_KMeans_iterations, Parallel_KMeans_average, Parallel_KMeans_min, Parallel_KMeans_max] = timing_results;
 
     // std::cout << "Kmeans all timings in milliseconds" << std::endl;
 